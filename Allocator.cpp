@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2016 Google, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "Helpers.h"
+#include "Allocator.h"
+
+namespace {
+
+VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+Allocator::Allocator(VkPhysicalDevice phy, VkDevice dev, VkDeviceSize block_size) : dev_(dev), block_size_(block_size) {
+    vk::GetPhysicalDeviceMemoryProperties(phy, &mem_props_);
+
+    VkPhysicalDeviceProperties props;
+    vk::GetPhysicalDeviceProperties(phy, &props);
+    non_coherent_atom_size_ = std::max<VkDeviceSize>(props.limits.nonCoherentAtomSize, 1);
+}
+
+Allocator::~Allocator() {
+    for (auto &block: blocks_) {
+        if (block.memory == VK_NULL_HANDLE) continue;
+
+        if (block.mapped) vk::UnmapMemory(dev_, block.memory);
+        vk::FreeMemory(dev_, block.memory, nullptr);
+    }
+}
+
+int Allocator::find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags flags) const {
+    for (uint32_t idx = 0; idx < mem_props_.memoryTypeCount; idx++) {
+        if ((type_bits & (1 << idx)) && (mem_props_.memoryTypes[idx].propertyFlags & flags) == flags)
+            return static_cast<int>(idx);
+    }
+
+    return -1;
+}
+
+Allocator::Allocation Allocator::allocate(const VkMemoryRequirements &reqs, VkMemoryPropertyFlags required,
+                                          VkMemoryPropertyFlags preferred, bool linear) {
+    int type = find_memory_type(reqs.memoryTypeBits, required | preferred);
+    if (type < 0) type = find_memory_type(reqs.memoryTypeBits, required);
+    if (type < 0) throw std::runtime_error("no memory type with the required properties");
+
+    return allocate_type(reqs, static_cast<uint32_t>(type), linear);
+}
+
+Allocator::Allocation Allocator::allocate_type(const VkMemoryRequirements &reqs, uint32_t type, bool linear) {
+    VkDeviceSize size = reqs.size;
+    VkDeviceSize alignment = std::max<VkDeviceSize>(reqs.alignment, 1);
+
+    // flushes and invalidations of non-coherent memory work in whole atoms
+    const VkMemoryPropertyFlags flags = memory_flags(type);
+    if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        alignment = std::max(alignment, non_coherent_atom_size_);
+        size = align_up(size, non_coherent_atom_size_);
+    }
+
+    int index = -1;
+    VkDeviceSize offset = 0;
+    for (size_t i = 0; i < blocks_.size() && index < 0; i++) {
+        Block &block = blocks_[i];
+        if (block.memory == VK_NULL_HANDLE || block.dedicated || block.type != type || block.linear != linear) continue;
+
+        if (sub_allocate(block, size, alignment, offset)) index = static_cast<int>(i);
+    }
+
+    if (index < 0) {
+        // a quarter of a small heap at most
+        const VkDeviceSize heap_size = mem_props_.memoryHeaps[mem_props_.memoryTypes[type].heapIndex].size;
+        const VkDeviceSize block_size = std::min(block_size_, std::max<VkDeviceSize>(heap_size / 4, 1));
+
+        const bool dedicated = size > block_size / 2;
+        index = create_block(type, linear, dedicated ? size : block_size, dedicated);
+        if (!sub_allocate(blocks_[index], size, alignment, offset))
+            throw std::runtime_error("allocation does not fit a new block");
+    }
+
+    Block &block = blocks_[index];
+    block.used += size;
+    block.allocation_count++;
+
+    Allocation alloc;
+    alloc.memory = block.memory;
+    alloc.offset = offset;
+    alloc.size = size;
+    alloc.mapped = block.mapped ? block.mapped + offset : nullptr;
+    alloc.block = index;
+
+    return alloc;
+}
+
+Allocator::Allocation Allocator::allocate_buffer(VkBuffer buf, VkMemoryPropertyFlags required,
+                                                 VkMemoryPropertyFlags preferred) {
+    VkMemoryRequirements reqs;
+    vk::GetBufferMemoryRequirements(dev_, buf, &reqs);
+
+    Allocation alloc = allocate(reqs, required, preferred, true);
+    vk::assert_success(vk::BindBufferMemory(dev_, buf, alloc.memory, alloc.offset));
+
+    return alloc;
+}
+
+void Allocator::free(Allocation &alloc) {
+    if (alloc.block < 0) return;
+
+    Block &block = blocks_[alloc.block];
+    block.used -= alloc.size;
+    block.allocation_count--;
+
+    if (block.dedicated) {
+        if (block.mapped) vk::UnmapMemory(dev_, block.memory);
+        vk::FreeMemory(dev_, block.memory, nullptr);
+        memory_allocation_count_--;
+        block = Block();
+    } else {
+        // merge with the free neighbors
+        auto next = block.free_ranges.emplace(alloc.offset, alloc.size).first;
+        if (next != block.free_ranges.begin()) {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == next->first) {
+                prev->second += next->second;
+                block.free_ranges.erase(next);
+                next = prev;
+            }
+        }
+        auto after = std::next(next);
+        if (after != block.free_ranges.end() && next->first + next->second == after->first) {
+            next->second += after->second;
+            block.free_ranges.erase(after);
+        }
+    }
+
+    alloc = Allocation();
+}
+
+int Allocator::create_block(uint32_t type, bool linear, VkDeviceSize size, bool dedicated) {
+    VkMemoryAllocateInfo mem_info = {};
+    mem_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    mem_info.allocationSize = size;
+    mem_info.memoryTypeIndex = type;
+
+    Block block;
+    vk::assert_success(vk::AllocateMemory(dev_, &mem_info, nullptr, &block.memory));
+    memory_allocation_count_++;
+
+    block.type = type;
+    block.linear = linear;
+    block.dedicated = dedicated;
+    block.size = size;
+    block.free_ranges.emplace(0, size);
+
+    if (memory_flags(type) & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        void *ptr;
+        vk::assert_success(vk::MapMemory(dev_, block.memory, 0, VK_WHOLE_SIZE, 0, &ptr));
+        block.mapped = reinterpret_cast<uint8_t *>(ptr);
+    }
+
+    // reuse the slot of a freed block
+    for (size_t i = 0; i < blocks_.size(); i++) {
+        if (blocks_[i].memory == VK_NULL_HANDLE) {
+            blocks_[i] = std::move(block);
+            return static_cast<int>(i);
+        }
+    }
+
+    blocks_.push_back(std::move(block));
+    return static_cast<int>(blocks_.size() - 1);
+}
+
+bool Allocator::sub_allocate(Block &block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset) {
+    for (auto it = block.free_ranges.begin(); it != block.free_ranges.end(); ++it) {
+        const VkDeviceSize range_begin = it->first;
+        const VkDeviceSize range_end = it->first + it->second;
+
+        const VkDeviceSize begin = align_up(range_begin, alignment);
+        if (begin + size > range_end) continue;
+
+        // keep the padding and the tail free
+        block.free_ranges.erase(it);
+        if (begin > range_begin) block.free_ranges.emplace(range_begin, begin - range_begin);
+        if (begin + size < range_end) block.free_ranges.emplace(begin + size, range_end - begin - size);
+
+        offset = begin;
+        return true;
+    }
+
+    return false;
+}
+
+std::vector<std::string> Allocator::stats() const {
+    struct TypeStats {
+        int blocks{};
+        int allocations{};
+        VkDeviceSize size{};
+        VkDeviceSize used{};
+        VkDeviceSize free{};
+        VkDeviceSize largest_free{};
+    };
+    std::map<uint32_t, TypeStats> types;
+
+    TypeStats total;
+    for (const auto &block: blocks_) {
+        if (block.memory == VK_NULL_HANDLE) continue;
+
+        TypeStats &type = types[block.type];
+        for (auto *stats: {&type, &total}) {
+            stats->blocks++;
+            stats->allocations += block.allocation_count;
+            stats->size += block.size;
+            stats->used += block.used;
+            for (const auto &range: block.free_ranges) {
+                stats->free += range.second;
+                stats->largest_free = std::max(stats->largest_free, range.second);
+            }
+        }
+    }
+
+    const auto kib = [](VkDeviceSize size) { return static_cast<double>(size) / 1024.0; };
+    // how much of the free memory is not in the largest free range
+    const auto fragmentation = [](const TypeStats &stats) {
+        return stats.free ? 100.0 * static_cast<double>(stats.free - stats.largest_free) / static_cast<double>(stats.free)
+                          : 0.0;
+    };
+
+    std::vector<std::string> lines;
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1) << "memory: " << memory_allocation_count_ << " device allocations, "
+       << total.allocations << " sub-allocations, " << kib(total.used) << " of " << kib(total.size) << " KiB used";
+    lines.push_back(ss.str());
+
+    for (const auto &[type, stats]: types) {
+        const VkMemoryPropertyFlags flags = memory_flags(type);
+
+        ss.str("");
+        ss << "  type " << type << " (" << ((flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ? "device local" : "")
+           << ((flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) && (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) ? ", " : "")
+           << ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) ? "host visible" : "") << "): " << stats.blocks
+           << " blocks, " << stats.allocations << " sub-allocations, " << kib(stats.used) << " of " << kib(stats.size)
+           << " KiB used, fragmentation " << fragmentation(stats) << "%";
+        lines.push_back(ss.str());
+    }
+
+    return lines;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2016 Google, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// Sub-allocates device memory out of large blocks, one list of blocks per
+// memory type, so that the number of vkAllocateMemory calls stays far below
+// maxMemoryAllocationCount however many objects and frames there are.
+//
+// Ranges are handed out first-fit from a free list per block and coalesce
+// when freed.  Linear resources (buffers) and non-linear ones (optimal
+// images) never share a block, which honors bufferImageGranularity without
+// padding.  Host-visible blocks are mapped once for their whole life.
+class Allocator {
+   public:
+    struct Allocation {
+        VkDeviceMemory memory{};
+        VkDeviceSize offset{};
+        VkDeviceSize size{};
+        // at offset, for host-visible memory
+        uint8_t *mapped{};
+
+        int block{-1};
+    };
+
+    Allocator(VkPhysicalDevice phy, VkDevice dev, VkDeviceSize block_size = 32 * 1024 * 1024);
+    ~Allocator();
+
+    Allocator(const Allocator &) = delete;
+    Allocator &operator=(const Allocator &) = delete;
+
+    // the first memory type allowed by type_bits that has all of flags, or -1
+    [[nodiscard]] int find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags flags) const;
+    [[nodiscard]] VkMemoryPropertyFlags memory_flags(uint32_t type) const { return mem_props_.memoryTypes[type].propertyFlags; }
+
+    // picks a type with all of required and, when there is one, all of preferred
+    Allocation allocate(const VkMemoryRequirements &reqs, VkMemoryPropertyFlags required,
+                        VkMemoryPropertyFlags preferred = 0, bool linear = true);
+    // from the given memory type
+    Allocation allocate_type(const VkMemoryRequirements &reqs, uint32_t type, bool linear = true);
+    void free(Allocation &alloc);
+
+    // binds a buffer to newly allocated memory
+    Allocation allocate_buffer(VkBuffer buf, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0);
+
+    // blocks, bytes used and fragmentation per memory type
+    [[nodiscard]] std::vector<std::string> stats() const;
+
+   private:
+    struct Block {
+        VkDeviceMemory memory{};
+        uint32_t type{};
+        bool linear{};
+        // holds a single allocation too large for a shared block
+        bool dedicated{};
+        VkDeviceSize size{};
+        uint8_t *mapped{};
+
+        // offset to size, ordered so that neighbors coalesce
+        std::map<VkDeviceSize, VkDeviceSize> free_ranges{};
+        VkDeviceSize used{};
+        int allocation_count{};
+    };
+
+    int create_block(uint32_t type, bool linear, VkDeviceSize size, bool dedicated);
+    static bool sub_allocate(Block &block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset);
+
+    VkDevice dev_;
+    VkPhysicalDeviceMemoryProperties mem_props_{};
+    VkDeviceSize non_coherent_atom_size_{};
+    VkDeviceSize block_size_;
+
+    // freed blocks leave a null slot so that indices stay valid
+    std::vector<Block> blocks_{};
+    uint32_t memory_allocation_count_{};
+};
+
+#endif  // ALLOCATOR_H
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2016 Google, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "FrameStats.h"
+
+namespace {
+
+constexpr std::array<double, 4> report_percentiles = {50.0, 90.0, 99.0, 99.9};
+
+}  // namespace
+
+void Histogram::record(double ms) {
+    const double us = std::clamp(ms * 1000.0, 0.0, std::ldexp(1.0, max_bits) - 1.0);
+    counts_[bucket_index(static_cast<uint64_t>(us))]++;
+
+    count_++;
+    sum_ms_ += ms;
+    max_ms_ = std::max(max_ms_, ms);
+}
+
+void Histogram::reset() {
+    counts_.fill(0);
+    count_ = 0;
+    sum_ms_ = 0.0;
+    max_ms_ = 0.0;
+}
+
+int Histogram::bucket_index(uint64_t us) {
+    if (us < sub_bucket_count) return static_cast<int>(us);
+
+    // keep the top sub_bucket_bits - 1 bits, the leading one included
+    const int shift = std::bit_width(us) - sub_bucket_bits;
+    const int half_count = sub_bucket_count / 2;
+    return sub_bucket_count + (shift - 1) * half_count + static_cast<int>(us >> shift) - half_count;
+}
+
+double Histogram::bucket_upper_ms(int index) {
+    if (index < sub_bucket_count) return static_cast<double>(index + 1) / 1000.0;
+
+    const int half_count = sub_bucket_count / 2;
+    const int shift = (index - sub_bucket_count) / half_count + 1;
+    const uint64_t sub = (index - sub_bucket_count) % half_count + half_count;
+    return static_cast<double>((sub + 1) << shift) / 1000.0;
+}
+
+double Histogram::percentile_ms(double p) const {
+    if (!count_) return 0.0;
+
+    const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p / 100.0 * static_cast<double>(count_))));
+    uint64_t seen = 0;
+    for (int i = 0; i < bucket_count; i++) {
+        seen += counts_[i];
+        if (seen >= rank) return std::min(bucket_upper_ms(i), max_ms_);
+    }
+
+    return max_ms_;
+}
+
+const char *FrameStats::phase_name(Phase phase) {
+    switch (phase) {
+        case PHASE_ACQUIRE:
+            return "acquire";
+        case PHASE_SIM:
+            return "sim";
+        case PHASE_FENCE_WAIT:
+            return "fence_wait";
+        case PHASE_RECORD:
+            return "record";
+        case PHASE_SUBMIT:
+            return "submit";
+        case PHASE_PRESENT:
+            return "present";
+        case PHASE_FRAME:
+            return "frame";
+        default:
+            return "unknown";
+    }
+}
+
+void FrameStats::record_first_present() {
+    const std::chrono::duration<double, std::milli> startup_time = std::chrono::steady_clock::now() - start_time_;
+    startup_ms_ = startup_time.count();
+}
+
+std::vector<std::string> FrameStats::summary() const {
+    std::vector<std::string> lines;
+    if (startup_ms_ >= 0.0) {
+        std::stringstream ss;
+        ss << std::left << std::setw(11) << "startup" << " first present after " << std::fixed << std::setprecision(3)
+           << startup_ms_ << " ms";
+        lines.push_back(ss.str());
+    }
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        const Histogram &hist = histograms_[phase];
+        if (!hist.count()) continue;
+
+        std::stringstream ss;
+        ss << std::left << std::setw(11) << phase_name(static_cast<Phase>(phase)) << std::right
+           << std::setprecision(3);
+        for (double p: report_percentiles)
+            ss << " p" << std::defaultfloat << p << " " << std::fixed << std::setw(8) << hist.percentile_ms(p);
+        ss << " max " << std::setw(8) << hist.max_ms() << " ms (" << hist.count() << " samples)";
+        lines.push_back(ss.str());
+    }
+
+    return lines;
+}
+
+bool FrameStats::write_report(const std::string &path, int frame_count, double elapsed_ms) const {
+    std::ofstream out(path);
+    if (!out) return false;
+
+    const bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+    return csv ? write_csv(out) : write_json(out, frame_count, elapsed_ms);
+}
+
+bool FrameStats::write_json(std::ostream &out, int frame_count, double elapsed_ms) const {
+    out << std::setprecision(6) << "{\n  \"frames\": " << frame_count << ",\n  \"elapsed_ms\": " << elapsed_ms
+        << ",\n  \"startup_ms\": " << startup_ms_ << ",\n  \"phases\": {";
+
+    const char *phase_sep = "\n";
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        const Histogram &hist = histograms_[phase];
+
+        out << phase_sep << "    \"" << phase_name(static_cast<Phase>(phase)) << "\": {\"count\": " << hist.count()
+            << ", \"mean_ms\": " << hist.mean_ms();
+        for (double p: report_percentiles) out << ", \"p" << p << "_ms\": " << hist.percentile_ms(p);
+        out << ", \"max_ms\": " << hist.max_ms() << ",\n      \"buckets\": [";
+
+        // [exclusive upper bound in ms, count]
+        const char *bucket_sep = "";
+        for (int i = 0; i < Histogram::bucket_count; i++) {
+            if (!hist.bucket(i)) continue;
+            out << bucket_sep << "[" << Histogram::bucket_upper_ms(i) << ", " << hist.bucket(i) << "]";
+            bucket_sep = ", ";
+        }
+        out << "]}";
+
+        phase_sep = ",\n";
+    }
+    out << "\n  }\n}\n";
+
+    return static_cast<bool>(out);
+}
+
+bool FrameStats::write_csv(std::ostream &out) const {
+    out << "phase,count,mean_ms";
+    for (double p: report_percentiles) out << ",p" << p << "_ms";
+    out << ",max_ms\n";
+
+    out << std::setprecision(6);
+
+    // a single sample
+    if (startup_ms_ >= 0.0) {
+        out << "startup,1," << startup_ms_;
+        for (size_t i = 0; i < report_percentiles.size() + 1; i++) out << "," << startup_ms_;
+        out << "\n";
+    }
+
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        const Histogram &hist = histograms_[phase];
+
+        out << phase_name(static_cast<Phase>(phase)) << "," << hist.count() << "," << hist.mean_ms();
+        for (double p: report_percentiles) out << "," << hist.percentile_ms(p);
+        out << "," << hist.max_ms() << "\n";
+    }
+
+    return static_cast<bool>(out);
+}
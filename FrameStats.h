@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2016 Google, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Log-linear histogram of durations in the spirit of HdrHistogram.  Memory is
+// fixed and recording is constant time.  Durations are kept in microseconds:
+// those below sub_bucket_count are exact and larger ones keep
+// sub_bucket_bits - 1 significant bits, i.e. are within 1/64 of the truth.
+class Histogram {
+   public:
+    static constexpr int sub_bucket_bits = 7;
+    static constexpr int sub_bucket_count = 1 << sub_bucket_bits;
+    // durations are clamped to 2^max_bits microseconds, over an hour
+    static constexpr int max_bits = 32;
+    static constexpr int bucket_count = sub_bucket_count + (max_bits - sub_bucket_bits) * (sub_bucket_count / 2);
+
+    void record(double ms);
+    void reset();
+
+    [[nodiscard]] uint64_t count() const { return count_; }
+    [[nodiscard]] double mean_ms() const { return count_ ? sum_ms_ / static_cast<double>(count_) : 0.0; }
+    [[nodiscard]] double max_ms() const { return max_ms_; }
+
+    // the upper bound of the bucket holding the p-th percentile, p in [0, 100]
+    [[nodiscard]] double percentile_ms(double p) const;
+
+    [[nodiscard]] uint64_t bucket(int index) const { return counts_[index]; }
+    // exclusive
+    static double bucket_upper_ms(int index);
+
+   private:
+    static int bucket_index(uint64_t us);
+
+    std::array<uint64_t, bucket_count> counts_{};
+    uint64_t count_{};
+    double sum_ms_{};
+    double max_ms_{};
+};
+
+// CPU time of the phases of a frame, recorded on the main thread by the shell
+// and the game.
+class FrameStats {
+   public:
+    enum Phase {
+        // waiting for and acquiring a back buffer
+        PHASE_ACQUIRE,
+        // the ticks run before a frame, for frames that ticked
+        PHASE_SIM,
+        // waiting for the frame data to be reusable
+        PHASE_FENCE_WAIT,
+        // recording, including the workers' secondary command buffers
+        PHASE_RECORD,
+        PHASE_SUBMIT,
+        PHASE_PRESENT,
+        // from one present to the next
+        PHASE_FRAME,
+
+        PHASE_COUNT,
+    };
+
+    static const char *phase_name(Phase phase);
+
+    void record(Phase phase, double ms) { histograms_[phase].record(ms); }
+
+    // the time from construction, i.e. the start of the game, to the first
+    // present, which covers device and pipeline creation
+    void record_first_present();
+    [[nodiscard]] double startup_ms() const { return startup_ms_; }
+    [[nodiscard]] const Histogram &histogram(Phase phase) const { return histograms_[phase]; }
+
+    // the startup time, then one line per phase with samples:
+    // p50/p90/p99/p99.9/max
+    [[nodiscard]] std::vector<std::string> summary() const;
+
+    // the percentiles and, for JSON, the non-empty buckets of every phase;
+    // the format follows the extension, .csv or otherwise JSON
+    [[nodiscard]] bool write_report(const std::string &path, int frame_count, double elapsed_ms) const;
+
+   private:
+    bool write_json(std::ostream &out, int frame_count, double elapsed_ms) const;
+    bool write_csv(std::ostream &out) const;
+
+    std::array<Histogram, PHASE_COUNT> histograms_{};
+
+    std::chrono::steady_clock::time_point start_time_ = std::chrono::steady_clock::now();
+    double startup_ms_{-1.0};
+};
+
+#endif  // FRAME_STATS_H
@@ -27,6 +27,31 @@ void Game::print_stats() {
     std::stringstream ss;
     ss << "frames:" << frame_count << ", elapses:" << elapsed_millis;
     shell_->log(Shell::LogPriority::LOG_INFO, ss.str().c_str());
+
+    // the tail is what stutters, not the average
+    for (const auto &line: frame_stats_.summary()) shell_->log(Shell::LogPriority::LOG_INFO, line.c_str());
+
+    if (!settings_.report_path.empty()) {
+        ss.str("");
+        if (frame_stats_.write_report(settings_.report_path, frame_count, static_cast<double>(elapsed_millis))) {
+            ss << "wrote frame time report to " << settings_.report_path;
+            shell_->log(Shell::LogPriority::LOG_INFO, ss.str().c_str());
+        } else {
+            ss << "failed to write frame time report to " << settings_.report_path;
+            shell_->log(Shell::LogPriority::LOG_ERR, ss.str().c_str());
+        }
+    }
+
+    if (!settings_.trace_path.empty()) {
+        ss.str("");
+        if (Trace::write(settings_.trace_path)) {
+            ss << "wrote trace to " << settings_.trace_path;
+            shell_->log(Shell::LogPriority::LOG_INFO, ss.str().c_str());
+        } else {
+            ss << "failed to write trace to " << settings_.trace_path;
+            shell_->log(Shell::LogPriority::LOG_ERR, ss.str().c_str());
+        }
+    }
 }
 
 void Game::quit() {
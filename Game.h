@@ -19,9 +19,15 @@
 
 #include <chrono>
 #include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
+#include "FrameStats.h"
+#include "Trace.h"
+
 class Shell;
 
 class Game {
@@ -36,6 +42,8 @@ class Game {
         int initial_height{};
         int queue_count{};
         int back_buffer_count{};
+        // frames the CPU may record ahead of the GPU
+        int frames_in_flight{};
         int ticks_per_second{};
         bool vsync{};
         bool animate{};
@@ -46,10 +54,29 @@ class Game {
         bool no_tick{};
         bool no_render{};
         bool no_present{};
+        // run without a window, presenting to a headless surface or offscreen images
+        bool headless{};
 
         bool flush_buffers{};
 
         int max_frame_count{};
+        // where to write the frame time report on quit, JSON or .csv
+        std::string report_path{};
+        // where to write a Chrome trace of the frame loop on quit
+        std::string trace_path{};
+        // where pipeline caches are kept across runs, one file per device;
+        // empty, the default, to not cache
+        std::string pipeline_cache_dir{};
+
+        int object_count{};
+        // relative weights of pyramids, icospheres and teapots
+        std::vector<int> mesh_mix{};
+        bool fixed_seed{};
+        unsigned int seed{};
+        // log the simulation state hash every N ticks
+        int hash_interval{};
+        // seconds to advance the simulation by before the first tick
+        float warm_start{};
     };
     [[nodiscard]] const Settings &settings() const { return settings_; }
 
@@ -73,6 +100,12 @@ class Game {
     virtual void on_tick() {}
     virtual void on_frame(float frame_pred) {}
 
+    // statistics gathered since the last call, appended to the shell's performance log
+    virtual std::string take_frame_stats() { return {}; }
+
+    // frame phase timings over the whole run, reported on quit
+    FrameStats &frame_stats() { return frame_stats_; }
+
     void print_stats();
     void quit();
 
@@ -86,6 +119,7 @@ class Game {
         settings_.initial_height = 1024;
         settings_.queue_count = 1;
         settings_.back_buffer_count = 1;
+        settings_.frames_in_flight = 2;
         settings_.ticks_per_second = 30;
         settings_.vsync = true;
         settings_.animate = true;
@@ -96,12 +130,28 @@ class Game {
         settings_.no_tick = false;
         settings_.no_render = false;
         settings_.no_present = false;
+        settings_.headless = false;
 
         settings_.flush_buffers = false;
         settings_.max_frame_count = -1;
 
+        settings_.object_count = 5000;
+        settings_.mesh_mix = {7, 2, 1};
+        settings_.fixed_seed = false;
+        settings_.seed = 0;
+        settings_.hash_interval = 0;
+        settings_.warm_start = 0.0f;
+
         parse_args(args);
 
+        // pick a seed anyway so that the run can be reproduced with --seed
+        if (!settings_.fixed_seed) settings_.seed = std::random_device()();
+
+        if (!settings_.trace_path.empty()) {
+            Trace::enable();
+            Trace::set_thread_name("main");
+        }
+
         frame_count = 0;
         // Record start time for printing stats later
         start_time = std::chrono::system_clock::now();
@@ -110,6 +160,8 @@ class Game {
     Settings settings_{};
     Shell *shell_{};
 
+    FrameStats frame_stats_{};
+
    private:
     void parse_args(const std::vector<std::string> &args) {
         for (auto it = args.begin(); it != args.end(); ++it) {
@@ -132,14 +184,68 @@ class Game {
                 settings_.no_render = true;
             } else if (*it == "--np") {
                 settings_.no_present = true;
+            } else if (*it == "--headless") {
+                settings_.headless = true;
             } else if (*it == "--flush") {
                 settings_.flush_buffers = true;
             } else if (*it == "--c") {
                 ++it;
                 settings_.max_frame_count = std::stoi(*it);
+            } else if (*it == "--report") {
+                ++it;
+                settings_.report_path = *it;
+            } else if (*it == "--trace") {
+                ++it;
+                settings_.trace_path = *it;
+            } else if (*it == "--pipeline-cache") {
+                ++it;
+                settings_.pipeline_cache_dir = *it;
+            } else if (*it == "--no-pipeline-cache") {
+                settings_.pipeline_cache_dir.clear();
+            } else if (*it == "--objects") {
+                ++it;
+                settings_.object_count = std::stoi(*it);
+                if (settings_.object_count < 1) throw std::runtime_error("--objects must be at least 1");
+            } else if (*it == "--mesh-mix") {
+                ++it;
+                settings_.mesh_mix = parse_mesh_mix(*it);
+            } else if (*it == "--seed") {
+                ++it;
+                settings_.fixed_seed = true;
+                settings_.seed = static_cast<unsigned int>(std::stoul(*it));
+            } else if (*it == "--hash-ticks") {
+                ++it;
+                settings_.hash_interval = std::stoi(*it);
+                if (settings_.hash_interval < 1) throw std::runtime_error("--hash-ticks must be at least 1");
+            } else if (*it == "--warm-start") {
+                ++it;
+                settings_.warm_start = std::stof(*it);
+                if (settings_.warm_start < 0.0f) throw std::runtime_error("--warm-start must not be negative");
+            } else if (*it == "--frames-in-flight") {
+                ++it;
+                settings_.frames_in_flight = std::stoi(*it);
+                if (settings_.frames_in_flight < 1 || settings_.frames_in_flight > 8)
+                    throw std::runtime_error("--frames-in-flight must be between 1 and 8");
             }
         }
     }
+
+    // parses "pyramid:icosphere:teapot" weights, e.g. "7:2:1"
+    static std::vector<int> parse_mesh_mix(const std::string &arg) {
+        std::vector<int> mix;
+        std::stringstream ss(arg);
+        std::string weight;
+        int total = 0;
+        while (std::getline(ss, weight, ':')) {
+            mix.push_back(std::stoi(weight));
+            if (mix.back() < 0) throw std::runtime_error("--mesh-mix weights must not be negative");
+            total += mix.back();
+        }
+
+        if (mix.size() != 3 || total == 0) throw std::runtime_error("--mesh-mix expects three weights, e.g. 7:2:1");
+
+        return mix;
+    }
 };
 
 #endif  // GAME_H
@@ -205,6 +205,13 @@ extern PFN_vkCreateWin32SurfaceKHR CreateWin32SurfaceKHR;
 extern PFN_vkGetPhysicalDeviceWin32PresentationSupportKHR GetPhysicalDeviceWin32PresentationSupportKHR;
 #endif
 
+// VK_KHR_draw_indirect_count
+extern PFN_vkCmdDrawIndirectCountKHR CmdDrawIndirectCountKHR;
+extern PFN_vkCmdDrawIndexedIndirectCountKHR CmdDrawIndexedIndirectCountKHR;
+
+// VK_EXT_headless_surface
+extern PFN_vkCreateHeadlessSurfaceEXT CreateHeadlessSurfaceEXT;
+
 // VK_EXT_debug_report
 extern PFN_vkCreateDebugReportCallbackEXT CreateDebugReportCallbackEXT;
 extern PFN_vkDestroyDebugReportCallbackEXT DestroyDebugReportCallbackEXT;
@@ -32,13 +32,32 @@ Game *create_game(int argc, char **argv) {
 
 }  // namespace
 
-#if defined(VK_USE_PLATFORM_XCB_KHR)
+#if defined(SHELL_HEADLESS)
 
-#include "ShellXcb.h"
+#include "ShellHeadless.h"
 
 int main(int argc, char **argv) {
     Game *game = create_game(argc, argv);
     {
+        ShellHeadless shell(*game);
+        shell.run();
+    }
+    delete game;
+
+    return 0;
+}
+
+#elif defined(VK_USE_PLATFORM_XCB_KHR)
+
+#include "ShellHeadless.h"
+#include "ShellXcb.h"
+
+int main(int argc, char **argv) {
+    Game *game = create_game(argc, argv);
+    if (game->settings().headless) {
+        ShellHeadless shell(*game);
+        shell.run();
+    } else {
         ShellXcb shell(*game);
         shell.run();
     }
@@ -49,11 +68,15 @@ int main(int argc, char **argv) {
 
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
 
+#include "ShellHeadless.h"
 #include "ShellWayland.h"
 
 int main(int argc, char **argv) {
     Game *game = create_game(argc, argv);
-    {
+    if (game->settings().headless) {
+        ShellHeadless shell(*game);
+        shell.run();
+    } else {
         ShellWayland shell(*game);
         shell.run();
     }
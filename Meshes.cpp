@@ -14,10 +14,13 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <cstring>
 #include <array>
+#include <stdexcept>
 #include <unordered_map>
 
 #include "Helpers.h"
@@ -101,6 +104,13 @@ class Mesh {
 
     [[nodiscard]] uint32_t vertex_count() const { return static_cast<uint32_t>(positions_.size()); }
 
+    [[nodiscard]] float bounding_radius() const {
+        float radius = 0.0f;
+        for (const auto &pos : positions_)
+            radius = std::max(radius, std::sqrt(pos.x * pos.x + pos.y * pos.y + pos.z * pos.z));
+        return radius;
+    }
+
     [[nodiscard]] VkDeviceSize vertex_buffer_size() const { return vertex_stride() * vertex_count(); }
 
     void vertex_buffer_write(void *data) const {
@@ -441,10 +451,15 @@ void build_meshes(std::array<Mesh, Meshes::MESH_COUNT> &meshes) {
     BuildTeapot build_teapot(meshes[Meshes::MESH_TEAPOT]);
 }
 
+double elapsed_ms(std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
 }  // namespace
 
-Meshes::Meshes(VkDevice dev, const std::vector<VkMemoryPropertyFlags> &mem_flags)
+Meshes::Meshes(VkDevice dev, Allocator &allocator, const UploadQueues &queues)
     : dev_(dev),
+      allocator_(allocator),
       vertex_input_binding_(Mesh::vertex_input_binding()),
       vertex_input_attrs_(Mesh::vertex_input_attributes()),
       vertex_input_state_(),
@@ -456,10 +471,12 @@ Meshes::Meshes(VkDevice dev, const std::vector<VkMemoryPropertyFlags> &mem_flags
     vertex_input_state_.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertex_input_attrs_.size());
     vertex_input_state_.pVertexAttributeDescriptions = vertex_input_attrs_.data();
 
+    const auto build_start = std::chrono::steady_clock::now();
     std::array<Mesh, MESH_COUNT> meshes;
     build_meshes(meshes);
 
     draw_commands_.reserve(meshes.size());
+    bounding_radii_.reserve(meshes.size());
     uint32_t first_index = 0;
     int32_t vertex_offset = 0;
     VkDeviceSize vb_size = 0;
@@ -473,6 +490,7 @@ Meshes::Meshes(VkDevice dev, const std::vector<VkMemoryPropertyFlags> &mem_flags
         draw.firstInstance = 0;
 
         draw_commands_.push_back(draw);
+        bounding_radii_.push_back(mesh.bounding_radius());
 
         first_index += mesh.index_count();
         vertex_offset += static_cast<int32_t>(mesh.vertex_count());
@@ -480,11 +498,28 @@ Meshes::Meshes(VkDevice dev, const std::vector<VkMemoryPropertyFlags> &mem_flags
         ib_size += mesh.index_buffer_size();
     }
 
-    allocate_resources(vb_size, ib_size, mem_flags);
+    const auto allocate_start = std::chrono::steady_clock::now();
+    const bool mappable = allocate_resources(vb_size, ib_size);
+
+    // vertices then indices
+    const VkDeviceSize ib_staging_offset = (vb_size + 15) / 16 * 16;
+    VkBuffer staging_buf = VK_NULL_HANDLE;
+    Allocator::Allocation staging_mem;
+    if (!mappable) {
+        VkBufferCreateInfo buf_info = {};
+        buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buf_info.size = ib_staging_offset + ib_size;
+        buf_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        vk::assert_success(vk::CreateBuffer(dev_, &buf_info, nullptr, &staging_buf));
+
+        staging_mem = allocator_.allocate_buffer(
+            staging_buf, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    }
 
-    uint8_t *vb_data, *ib_data;
-    vk::assert_success(vk::MapMemory(dev_, mem_, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **>(&vb_data)));
-    ib_data = vb_data + ib_mem_offset_;
+    const auto write_start = std::chrono::steady_clock::now();
+    uint8_t *vb_data = mappable ? vb_mem_.mapped : staging_mem.mapped;
+    uint8_t *ib_data = mappable ? ib_mem_.mapped : staging_mem.mapped + ib_staging_offset;
 
     for (const auto &mesh : meshes) {
         mesh.vertex_buffer_write(vb_data);
@@ -493,13 +528,28 @@ Meshes::Meshes(VkDevice dev, const std::vector<VkMemoryPropertyFlags> &mem_flags
         ib_data += mesh.index_buffer_size();
     }
 
-    vk::UnmapMemory(dev_, mem_);
+    const auto transfer_start = std::chrono::steady_clock::now();
+    if (!mappable) {
+        upload(staging_buf, vb_size, ib_staging_offset, ib_size, queues);
+
+        vk::DestroyBuffer(dev_, staging_buf, nullptr);
+        allocator_.free(staging_mem);
+    }
+    const auto upload_end = std::chrono::steady_clock::now();
+
+    upload_stats_.staged = !mappable;
+    upload_stats_.size = vb_size + ib_size;
+    upload_stats_.build_ms = elapsed_ms(build_start, allocate_start);
+    upload_stats_.allocate_ms = elapsed_ms(allocate_start, write_start);
+    upload_stats_.write_ms = elapsed_ms(write_start, transfer_start);
+    upload_stats_.transfer_ms = elapsed_ms(transfer_start, upload_end);
 }
 
 Meshes::~Meshes() {
-    vk::FreeMemory(dev_, mem_, nullptr);
     vk::DestroyBuffer(dev_, vb_, nullptr);
     vk::DestroyBuffer(dev_, ib_, nullptr);
+    allocator_.free(vb_mem_);
+    allocator_.free(ib_mem_);
 }
 
 void Meshes::cmd_bind_buffers(VkCommandBuffer cmd) const {
@@ -513,41 +563,148 @@ void Meshes::cmd_draw(VkCommandBuffer cmd, Type type) const {
     vk::CmdDrawIndexed(cmd, draw.indexCount, draw.instanceCount, draw.firstIndex, draw.vertexOffset, draw.firstInstance);
 }
 
-void Meshes::allocate_resources(VkDeviceSize vb_size, VkDeviceSize ib_size, const std::vector<VkMemoryPropertyFlags> &mem_flags) {
+void Meshes::cmd_draw_instanced(VkCommandBuffer cmd, Type type, int instance_count, int first_instance) const {
+    const auto &draw = draw_commands_[type];
+    vk::CmdDrawIndexed(cmd, draw.indexCount, static_cast<uint32_t>(instance_count), draw.firstIndex, draw.vertexOffset,
+                       static_cast<uint32_t>(first_instance));
+}
+
+bool Meshes::allocate_resources(VkDeviceSize vb_size, VkDeviceSize ib_size) {
     VkBufferCreateInfo buf_info = {};
     buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     buf_info.size = vb_size;
-    buf_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    buf_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
     buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     vk::CreateBuffer(dev_, &buf_info, nullptr, &vb_);
 
     buf_info.size = ib_size;
-    buf_info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    buf_info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
     vk::CreateBuffer(dev_, &buf_info, nullptr, &ib_);
 
     VkMemoryRequirements vb_mem_reqs, ib_mem_reqs;
     vk::GetBufferMemoryRequirements(dev_, vb_, &vb_mem_reqs);
     vk::GetBufferMemoryRequirements(dev_, ib_, &ib_mem_reqs);
 
-    // indices follow vertices
-    ib_mem_offset_ = vb_mem_reqs.size + (ib_mem_reqs.alignment - (vb_mem_reqs.size % ib_mem_reqs.alignment));
-
-    VkMemoryAllocateInfo mem_info = {};
-    mem_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    mem_info.allocationSize = ib_mem_offset_ + ib_mem_reqs.size;
-
-    // find any supported and mappable memory type
-    uint32_t mem_types = (vb_mem_reqs.memoryTypeBits & ib_mem_reqs.memoryTypeBits);
-    for (uint32_t idx = 0; idx < mem_flags.size(); idx++) {
-        if ((mem_types & (1 << idx)) && (mem_flags[idx] & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
-            (mem_flags[idx] & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
-            // TODO this may not be reachable
-            mem_info.memoryTypeIndex = idx;
-            break;
+    // Prefer device-local memory that can be written in place, as on UMA
+    // devices, then device-local memory behind a staging copy, and settle
+    // for mappable memory the GPU reads across the bus.
+    const uint32_t mem_types = (vb_mem_reqs.memoryTypeBits & ib_mem_reqs.memoryTypeBits);
+    const VkMemoryPropertyFlags mappable_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    int mem_type = allocator_.find_memory_type(mem_types, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | mappable_flags);
+    bool mappable = true;
+    if (mem_type < 0) {
+        mem_type = allocator_.find_memory_type(mem_types, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        mappable = false;
+    }
+    if (mem_type < 0) {
+        mem_type = allocator_.find_memory_type(mem_types, mappable_flags);
+        mappable = true;
+    }
+    if (mem_type < 0) throw std::runtime_error("no memory type for meshes");
+
+    vb_mem_ = allocator_.allocate_type(vb_mem_reqs, static_cast<uint32_t>(mem_type));
+    ib_mem_ = allocator_.allocate_type(ib_mem_reqs, static_cast<uint32_t>(mem_type));
+    vk::assert_success(vk::BindBufferMemory(dev_, vb_, vb_mem_.memory, vb_mem_.offset));
+    vk::assert_success(vk::BindBufferMemory(dev_, ib_, ib_mem_.memory, ib_mem_.offset));
+
+    return mappable;
+}
+
+void Meshes::upload(VkBuffer staging_buf, VkDeviceSize vb_size, VkDeviceSize ib_staging_offset, VkDeviceSize ib_size,
+                    const UploadQueues &queues) {
+    // the buffers are exclusive to the graphics family once uploaded
+    const bool handover = queues.transfer_family != queues.graphics_family;
+    const uint32_t submit_count = handover ? 2 : 1;
+    const std::array<uint32_t, 2> families = {queues.transfer_family, queues.graphics_family};
+    const std::array<VkQueue, 2> submit_queues = {queues.transfer, queues.graphics};
+
+    std::array<VkCommandPool, 2> pools = {};
+    std::array<VkCommandBuffer, 2> cmds = {};
+    for (uint32_t i = 0; i < submit_count; i++) {
+        VkCommandPoolCreateInfo pool_info = {};
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        pool_info.queueFamilyIndex = families[i];
+        vk::assert_success(vk::CreateCommandPool(dev_, &pool_info, nullptr, &pools[i]));
+
+        VkCommandBufferAllocateInfo cmd_info = {};
+        cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cmd_info.commandPool = pools[i];
+        cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        cmd_info.commandBufferCount = 1;
+        vk::assert_success(vk::AllocateCommandBuffers(dev_, &cmd_info, &cmds[i]));
+
+        VkCommandBufferBeginInfo begin_info = {};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vk::assert_success(vk::BeginCommandBuffer(cmds[i], &begin_info));
+    }
+
+    VkBufferCopy vb_copy = {0, 0, vb_size};
+    VkBufferCopy ib_copy = {ib_staging_offset, 0, ib_size};
+    vk::CmdCopyBuffer(cmds[0], staging_buf, vb_, 1, &vb_copy);
+    vk::CmdCopyBuffer(cmds[0], staging_buf, ib_, 1, &ib_copy);
+
+    std::array<VkBufferMemoryBarrier, 2> barriers = {};
+    for (size_t i = 0; i < barriers.size(); i++) {
+        barriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barriers[i].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[i].dstAccessMask = (i == 0) ? VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT : VK_ACCESS_INDEX_READ_BIT;
+        barriers[i].srcQueueFamilyIndex = handover ? queues.transfer_family : VK_QUEUE_FAMILY_IGNORED;
+        barriers[i].dstQueueFamilyIndex = handover ? queues.graphics_family : VK_QUEUE_FAMILY_IGNORED;
+        barriers[i].buffer = (i == 0) ? vb_ : ib_;
+        barriers[i].offset = 0;
+        barriers[i].size = VK_WHOLE_SIZE;
+    }
+
+    if (handover) {
+        // released by the transfer queue and acquired by the graphics queue,
+        // which waits on a semaphore for the release
+        vk::CmdPipelineBarrier(cmds[0], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
+                               nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+        vk::CmdPipelineBarrier(cmds[1], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0,
+                               nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+    } else {
+        vk::CmdPipelineBarrier(cmds[0], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0,
+                               nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+    }
+
+    for (uint32_t i = 0; i < submit_count; i++) vk::assert_success(vk::EndCommandBuffer(cmds[i]));
+
+    VkSemaphore released = VK_NULL_HANDLE;
+    if (handover) {
+        VkSemaphoreCreateInfo sem_info = {};
+        sem_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        vk::assert_success(vk::CreateSemaphore(dev_, &sem_info, nullptr, &released));
+    }
+
+    VkFence fence;
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    vk::assert_success(vk::CreateFence(dev_, &fence_info, nullptr, &fence));
+
+    const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    for (uint32_t i = 0; i < submit_count; i++) {
+        VkSubmitInfo submit_info = {};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &cmds[i];
+        if (handover && i == 0) {
+            submit_info.signalSemaphoreCount = 1;
+            submit_info.pSignalSemaphores = &released;
+        } else if (handover) {
+            submit_info.waitSemaphoreCount = 1;
+            submit_info.pWaitSemaphores = &released;
+            submit_info.pWaitDstStageMask = &wait_stage;
         }
+
+        const bool last = (i == submit_count - 1);
+        vk::assert_success(vk::QueueSubmit(submit_queues[i], 1, &submit_info, last ? fence : VK_NULL_HANDLE));
     }
 
-    vk::AllocateMemory(dev_, &mem_info, nullptr, &mem_);
-    vk::BindBufferMemory(dev_, vb_, mem_, 0);
-    vk::BindBufferMemory(dev_, ib_, mem_, ib_mem_offset_);
+    vk::assert_success(vk::WaitForFences(dev_, 1, &fence, true, UINT64_MAX));
+
+    vk::DestroyFence(dev_, fence, nullptr);
+    if (released != VK_NULL_HANDLE) vk::DestroySemaphore(dev_, released, nullptr);
+    for (uint32_t i = 0; i < submit_count; i++) vk::DestroyCommandPool(dev_, pools[i], nullptr);
 }
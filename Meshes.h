@@ -20,11 +20,36 @@
 #include <vulkan/vulkan.h>
 #include <vector>
 
+#include "Allocator.h"
+
 class Meshes {
    public:
-    Meshes(VkDevice dev, const std::vector<VkMemoryPropertyFlags> &mem_flags);
+    // Mesh data is copied to device-local memory on the transfer queue and
+    // handed over to the graphics queue, unless it can be written in place.
+    struct UploadQueues {
+        VkQueue graphics;
+        uint32_t graphics_family;
+        VkQueue transfer;
+        uint32_t transfer_family;
+    };
+
+    // where the startup time of the constructor went
+    struct UploadStats {
+        // through a staging buffer, rather than written in place
+        bool staged;
+        VkDeviceSize size;
+        double build_ms;
+        double allocate_ms;
+        double write_ms;
+        double transfer_ms;
+    };
+
+    // buffers are sub-allocated from allocator, which must outlive the meshes
+    Meshes(VkDevice dev, Allocator &allocator, const UploadQueues &queues);
     ~Meshes();
 
+    [[nodiscard]] const UploadStats &upload_stats() const { return upload_stats_; }
+
     [[nodiscard]] const VkPipelineVertexInputStateCreateInfo &vertex_input_state() const { return vertex_input_state_; }
     [[nodiscard]] const VkPipelineInputAssemblyStateCreateInfo &input_assembly_state() const { return input_assembly_state_; }
 
@@ -35,13 +60,22 @@ class Meshes {
         MESH_COUNT
     };
 
+    [[nodiscard]] const VkDrawIndexedIndirectCommand &draw_command(Type type) const { return draw_commands_[type]; }
+    // radius of the bounding sphere centered at the mesh origin
+    [[nodiscard]] float bounding_radius(Type type) const { return bounding_radii_[type]; }
+
     void cmd_bind_buffers(VkCommandBuffer cmd) const;
     void cmd_draw(VkCommandBuffer cmd, Type type) const;
+    void cmd_draw_instanced(VkCommandBuffer cmd, Type type, int instance_count, int first_instance) const;
 
    private:
-    void allocate_resources(VkDeviceSize vb_size, VkDeviceSize ib_size, const std::vector<VkMemoryPropertyFlags> &mem_flags);
+    // returns whether the memory is mappable, or else needs staging
+    bool allocate_resources(VkDeviceSize vb_size, VkDeviceSize ib_size);
+    void upload(VkBuffer staging_buf, VkDeviceSize vb_size, VkDeviceSize ib_staging_offset, VkDeviceSize ib_size,
+                const UploadQueues &queues);
 
     VkDevice dev_{};
+    Allocator &allocator_;
 
     VkVertexInputBindingDescription vertex_input_binding_{};
     std::vector<VkVertexInputAttributeDescription> vertex_input_attrs_{};
@@ -50,11 +84,14 @@ class Meshes {
     VkIndexType index_type_{};
 
     std::vector<VkDrawIndexedIndirectCommand> draw_commands_{};
+    std::vector<float> bounding_radii_{};
 
     VkBuffer vb_{};
     VkBuffer ib_{};
-    VkDeviceMemory mem_{};
-    VkDeviceSize ib_mem_offset_{};
+    Allocator::Allocation vb_mem_{};
+    Allocator::Allocation ib_mem_{};
+
+    UploadStats upload_stats_{};
 };
 
 #endif  // MESHES_H
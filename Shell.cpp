@@ -15,6 +15,7 @@
  */
 
 #include <cassert>
+#include <algorithm>
 #include <array>
 #include <iostream>
 #include <string>
@@ -24,6 +25,7 @@
 #include "Helpers.h"
 #include "Shell.h"
 #include "Game.h"
+#include "Trace.h"
 
 using namespace std;
 
@@ -33,6 +35,7 @@ Shell::Shell(Game &game)
     // require generic WSI extensions
     instance_extensions_.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
     device_extensions_.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    optional_device_extensions_.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
 
     if (settings_.validate) {
         instance_extensions_.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
@@ -138,10 +141,27 @@ bool Shell::has_all_device_extensions(VkPhysicalDevice phy) const {
     return true;
 }
 
+bool Shell::has_instance_extension(const char *name) const {
+    return std::any_of(instance_extensions_.begin(), instance_extensions_.end(),
+                       [name](const char *ext) { return std::string(ext) == name; });
+}
+
 void Shell::init_instance() {
     assert_all_instance_layers();
     assert_all_instance_extensions();
 
+    // add the supported optional extensions
+    std::vector<VkExtensionProperties> exts;
+    vk::enumerate(nullptr, exts);
+
+    std::set<std::string> ext_names;
+    for (const auto &ext: exts) ext_names.insert(ext.extensionName);
+
+    for (const auto &name: optional_instance_extensions_) {
+        if (ext_names.find(name) != ext_names.end() && !has_instance_extension(name))
+            instance_extensions_.push_back(name);
+    }
+
     VkApplicationInfo app_info = {};
     app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
     app_info.pApplicationName = settings_.name.c_str();
@@ -211,6 +231,16 @@ void Shell::init_physical_dev() {
             ctx_.physical_dev = phy;
             ctx_.game_queue_family = game_queue_family;
             ctx_.present_queue_family = present_queue_family;
+
+            // usually backed by a DMA engine
+            ctx_.transfer_queue_family = game_queue_family;
+            for (uint32_t i = 0; i < queues.size(); i++) {
+                const VkFlags flags = queues[i].queueFlags;
+                if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+                    ctx_.transfer_queue_family = i;
+                    break;
+                }
+            }
             break;
         }
     }
@@ -255,6 +285,7 @@ void Shell::create_context() {
     vk::init_dispatch_table_bottom(ctx_.instance, ctx_.dev);
     vk::GetDeviceQueue(ctx_.dev, ctx_.game_queue_family, 0, &ctx_.game_queue);
     vk::GetDeviceQueue(ctx_.dev, ctx_.present_queue_family, 0, &ctx_.present_queue);
+    vk::GetDeviceQueue(ctx_.dev, ctx_.transfer_queue_family, 0, &ctx_.transfer_queue);
 
     create_back_buffers();
 
@@ -278,6 +309,7 @@ void Shell::destroy_context() {
 
     ctx_.game_queue = VK_NULL_HANDLE;
     ctx_.present_queue = VK_NULL_HANDLE;
+    ctx_.transfer_queue = VK_NULL_HANDLE;
 
     vk::DestroyDevice(ctx_.dev, nullptr);
     ctx_.dev = VK_NULL_HANDLE;
@@ -288,31 +320,57 @@ void Shell::create_dev() {
     dev_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
     const std::vector<float> queue_priorities(settings_.queue_count, 0.0f);
-    std::array<VkDeviceQueueCreateInfo, 2> queue_info = {};
+    std::array<VkDeviceQueueCreateInfo, 3> queue_info = {};
     queue_info[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
     queue_info[0].queueFamilyIndex = ctx_.game_queue_family;
     queue_info[0].queueCount = settings_.queue_count;
     queue_info[0].pQueuePriorities = queue_priorities.data();
+    dev_info.queueCreateInfoCount = 1;
 
     if (ctx_.game_queue_family != ctx_.present_queue_family) {
-        queue_info[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-        queue_info[1].queueFamilyIndex = ctx_.present_queue_family;
-        queue_info[1].queueCount = 1;
-        queue_info[1].pQueuePriorities = queue_priorities.data();
+        auto &info = queue_info[dev_info.queueCreateInfoCount++];
+        info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        info.queueFamilyIndex = ctx_.present_queue_family;
+        info.queueCount = 1;
+        info.pQueuePriorities = queue_priorities.data();
+    }
 
-        dev_info.queueCreateInfoCount = 2;
-    } else {
-        dev_info.queueCreateInfoCount = 1;
+    // when the transfer family is one of its own
+    if (ctx_.transfer_queue_family != ctx_.game_queue_family &&
+        ctx_.transfer_queue_family != ctx_.present_queue_family) {
+        auto &info = queue_info[dev_info.queueCreateInfoCount++];
+        info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        info.queueFamilyIndex = ctx_.transfer_queue_family;
+        info.queueCount = 1;
+        info.pQueuePriorities = queue_priorities.data();
     }
 
     dev_info.pQueueCreateInfos = queue_info.data();
 
-    dev_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions_.size());
-    dev_info.ppEnabledExtensionNames = device_extensions_.data();
+    // add the supported optional extensions
+    std::vector<VkExtensionProperties> exts;
+    vk::enumerate(ctx_.physical_dev, nullptr, exts);
+
+    std::set<std::string> ext_names;
+    for (const auto &ext: exts) ext_names.insert(ext.extensionName);
+
+    std::vector<const char *> dev_exts = device_extensions_;
+    for (const auto &name: optional_device_extensions_) {
+        if (ext_names.find(name) != ext_names.end()) dev_exts.push_back(name);
+    }
+    ctx_.draw_indirect_count = ext_names.find(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) != ext_names.end();
+
+    dev_info.enabledExtensionCount = static_cast<uint32_t>(dev_exts.size());
+    dev_info.ppEnabledExtensionNames = dev_exts.data();
 
-    // disable all features
-    VkPhysicalDeviceFeatures features = {};
-    dev_info.pEnabledFeatures = &features;
+    // enable only the supported features the indirect draw path uses
+    VkPhysicalDeviceFeatures supported;
+    vk::GetPhysicalDeviceFeatures(ctx_.physical_dev, &supported);
+
+    ctx_.features = {};
+    ctx_.features.multiDrawIndirect = supported.multiDrawIndirect;
+    ctx_.features.drawIndirectFirstInstance = supported.drawIndirectFirstInstance;
+    dev_info.pEnabledFeatures = &ctx_.features;
 
     vk::assert_success(vk::CreateDevice(ctx_.physical_dev, &dev_info, nullptr, &ctx_.dev));
 }
@@ -353,7 +411,22 @@ void Shell::destroy_back_buffers() {
 }
 
 void Shell::create_swapchain() {
+    // defer to resize_swapchain()
+    ctx_.swapchain = VK_NULL_HANDLE;
+    ctx_.extent.width = (uint32_t) -1;
+    ctx_.extent.height = (uint32_t) -1;
+
+    if (offscreen_) {
+        ctx_.surface = VK_NULL_HANDLE;
+        // mandatory as a color attachment
+        ctx_.format = {VK_FORMAT_R8G8B8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
+        // ready to be read back
+        ctx_.image_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        return;
+    }
+
     ctx_.surface = create_surface(ctx_.instance);
+    ctx_.image_layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkBool32 supported;
     vk::assert_success(
@@ -365,14 +438,14 @@ void Shell::create_swapchain() {
     std::vector<VkSurfaceFormatKHR> formats;
     vk::get(ctx_.physical_dev, ctx_.surface, formats);
     ctx_.format = formats[0];
-
-    // defer to resize_swapchain()
-    ctx_.swapchain = VK_NULL_HANDLE;
-    ctx_.extent.width = (uint32_t) -1;
-    ctx_.extent.height = (uint32_t) -1;
 }
 
 void Shell::destroy_swapchain() {
+    if (offscreen_) {
+        destroy_offscreen_images();
+        return;
+    }
+
     if (ctx_.swapchain != VK_NULL_HANDLE) {
         game_.detach_swapchain();
 
@@ -391,6 +464,11 @@ void Shell::resize_swapchain(uint32_t width_hint, uint32_t height_hint) {
         vk::DeviceWaitIdle(ctx_.dev);
     }
 
+    if (offscreen_) {
+        resize_offscreen(width_hint, height_hint);
+        return;
+    }
+
     VkSurfaceCapabilitiesKHR caps;
     vk::assert_success(vk::GetPhysicalDeviceSurfaceCapabilitiesKHR(ctx_.physical_dev, ctx_.surface, &caps));
 
@@ -468,6 +546,7 @@ void Shell::resize_swapchain(uint32_t width_hint, uint32_t height_hint) {
 
     vk::assert_success(vk::CreateSwapchainKHR(ctx_.dev, &swapchain_info, nullptr, &ctx_.swapchain));
     ctx_.extent = extent;
+    vk::get(ctx_.dev, ctx_.swapchain, ctx_.images);
 
     // destroy the old swapchain
     if (swapchain_info.oldSwapchain != VK_NULL_HANDLE) {
@@ -480,18 +559,142 @@ void Shell::resize_swapchain(uint32_t width_hint, uint32_t height_hint) {
     game_.attach_swapchain();
 }
 
+void Shell::resize_offscreen(uint32_t width_hint, uint32_t height_hint) {
+    // there is no window to take the size from
+    VkExtent2D extent = {width_hint, height_hint};
+    if (!width_hint || !height_hint) {
+        extent.width = static_cast<uint32_t>(settings_.initial_width);
+        extent.height = static_cast<uint32_t>(settings_.initial_height);
+    }
+
+    if (!ctx_.images.empty() && ctx_.extent.width == extent.width && ctx_.extent.height == extent.height) return;
+
+    destroy_offscreen_images();
+
+    VkImageCreateInfo image_info = {};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = ctx_.format.format;
+    image_info.extent = {extent.width, extent.height, 1};
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkPhysicalDeviceMemoryProperties mem_props;
+    vk::GetPhysicalDeviceMemoryProperties(ctx_.physical_dev, &mem_props);
+
+    // one image per back buffer, so that waiting on a back buffer's fence
+    // also waits for the last frame rendered to its image
+    for (int i = 0; i < settings_.back_buffer_count + 1; i++) {
+        VkImage image;
+        vk::assert_success(vk::CreateImage(ctx_.dev, &image_info, nullptr, &image));
+
+        VkMemoryRequirements mem_reqs;
+        vk::GetImageMemoryRequirements(ctx_.dev, image, &mem_reqs);
+
+        // prefer device-local memory
+        VkMemoryAllocateInfo mem_info = {};
+        mem_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        mem_info.allocationSize = mem_reqs.size;
+        mem_info.memoryTypeIndex = UINT32_MAX;
+        for (uint32_t idx = 0; idx < mem_props.memoryTypeCount; idx++) {
+            if (!(mem_reqs.memoryTypeBits & (1 << idx))) continue;
+
+            if (mem_info.memoryTypeIndex == UINT32_MAX ||
+                (mem_props.memoryTypes[idx].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+                mem_info.memoryTypeIndex = idx;
+                if (mem_props.memoryTypes[idx].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) break;
+            }
+        }
+        if (mem_info.memoryTypeIndex == UINT32_MAX) throw std::runtime_error("no memory type for offscreen images");
+
+        VkDeviceMemory mem;
+        vk::assert_success(vk::AllocateMemory(ctx_.dev, &mem_info, nullptr, &mem));
+        vk::assert_success(vk::BindImageMemory(ctx_.dev, image, mem, 0));
+
+        ctx_.images.push_back(image);
+        offscreen_mems_.push_back(mem);
+    }
+
+    ctx_.extent = extent;
+    next_offscreen_image_ = 0;
+
+    game_.attach_swapchain();
+}
+
+void Shell::destroy_offscreen_images() {
+    if (ctx_.images.empty()) return;
+
+    game_.detach_swapchain();
+
+    for (auto image: ctx_.images) vk::DestroyImage(ctx_.dev, image, nullptr);
+    for (auto mem: offscreen_mems_) vk::FreeMemory(ctx_.dev, mem, nullptr);
+    ctx_.images.clear();
+    offscreen_mems_.clear();
+}
+
 void Shell::add_game_time(float time) {
     int max_ticks = 3;
 
     if (!settings_.no_tick) game_time_ += time;
 
+    if (game_time_ < game_tick_) return;
+
+    const auto sim_start = std::chrono::steady_clock::now();
     while (game_time_ >= game_tick_ && max_ticks--) {
         game_.on_tick();
         game_time_ -= game_tick_;
     }
+    const std::chrono::duration<double, std::milli> sim_time = std::chrono::steady_clock::now() - sim_start;
+    game_.frame_stats().record(FrameStats::PHASE_SIM, sim_time.count());
+}
+
+void Shell::animate_frame() {
+    // the clock starts with the first frame
+    if (frame_time_ == std::chrono::steady_clock::time_point{}) {
+        frame_time_ = std::chrono::steady_clock::now();
+        profile_start_time_ = frame_time_;
+    }
+
+    acquire_back_buffer();
+
+    const auto now = std::chrono::steady_clock::now();
+    add_game_time(std::chrono::duration<float>(now - frame_time_).count());
+
+    present_back_buffer();
+
+    frame_time_ = now;
+
+    profile_present_count_++;
+    const std::chrono::duration<double> profile_time = frame_time_ - profile_start_time_;
+    if (profile_time.count() >= 5.0) {
+        const double fps = profile_present_count_ / profile_time.count();
+        std::stringstream ss;
+        ss << std::right << std::setw(5) << profile_present_count_ << " presents in " << std::left << std::setw(7)
+           << profile_time.count() << " seconds "
+           << "(FPS: " << std::left << std::setw(7) << fps << ")";
+        const std::string stats = game_.take_frame_stats();
+        if (!stats.empty()) ss << " " << stats;
+        log(LOG_INFO, ss.str().c_str());
+
+        profile_start_time_ = frame_time_;
+        profile_present_count_ = 0;
+    }
 }
 
 void Shell::acquire_back_buffer() {
+    TraceScope trace("acquire");
+    const auto acquire_start = std::chrono::steady_clock::now();
+    acquire_image();
+    const std::chrono::duration<double, std::milli> acquire_time = std::chrono::steady_clock::now() - acquire_start;
+    game_.frame_stats().record(FrameStats::PHASE_ACQUIRE, acquire_time.count());
+}
+
+void Shell::acquire_image() {
     // acquire just once when not presenting
     if (settings_.no_present && ctx_.acquired_back_buffer.acquire_semaphore != VK_NULL_HANDLE) return;
 
@@ -502,6 +705,22 @@ void Shell::acquire_back_buffer() {
     // reset the fence
     vk::assert_success(vk::ResetFences(ctx_.dev, 1, &buf.present_fence));
 
+    if (offscreen_) {
+        buf.image_index = next_offscreen_image_;
+        next_offscreen_image_ = (next_offscreen_image_ + 1) % static_cast<uint32_t>(ctx_.images.size());
+
+        // the image is free once the fence signals; signal the semaphore the game waits on
+        VkSubmitInfo submit_info = {};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores = &buf.acquire_semaphore;
+        vk::assert_success(vk::QueueSubmit(ctx_.game_queue, 1, &submit_info, VK_NULL_HANDLE));
+
+        ctx_.acquired_back_buffer = buf;
+        ctx_.back_buffers.pop();
+        return;
+    }
+
     // Attempts to acquire the next image
     VkResult res = vk::AcquireNextImageKHR(ctx_.dev, ctx_.swapchain, UINT64_MAX, buf.acquire_semaphore, VK_NULL_HANDLE,
                                            &buf.image_index);
@@ -529,15 +748,55 @@ void Shell::acquire_back_buffer() {
 }
 
 void Shell::present_back_buffer() {
-    const auto &buf = ctx_.acquired_back_buffer;
-
     if (!settings_.no_render) game_.on_frame(game_time_ / game_tick_);
 
+    const auto present_start = std::chrono::steady_clock::now();
+    present_image();
+    const auto present_end = std::chrono::steady_clock::now();
+
+    const std::chrono::duration<double, std::milli> present_time = present_end - present_start;
+    game_.frame_stats().record(FrameStats::PHASE_PRESENT, present_time.count());
+
+    if (!presented_) {
+        game_.frame_stats().record_first_present();
+
+        std::stringstream ss;
+        ss << "first frame presented " << std::fixed << std::setprecision(1) << game_.frame_stats().startup_ms()
+           << " ms after start";
+        log(LOG_INFO, ss.str().c_str());
+    }
+
+    // the interval between presents is what stutters
+    if (presented_) {
+        const std::chrono::duration<double, std::milli> frame_time = present_end - last_present_;
+        game_.frame_stats().record(FrameStats::PHASE_FRAME, frame_time.count());
+    }
+    last_present_ = present_end;
+    presented_ = true;
+}
+
+void Shell::present_image() {
+    const auto &buf = ctx_.acquired_back_buffer;
+
     if (settings_.no_present) {
         fake_present();
         return;
     }
 
+    if (offscreen_) {
+        // consume the semaphore and signal the fence once rendering is done
+        VkPipelineStageFlags stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        VkSubmitInfo submit_info = {};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.waitSemaphoreCount = 1;
+        submit_info.pWaitSemaphores = (settings_.no_render) ? &buf.acquire_semaphore : &buf.render_semaphore;
+        submit_info.pWaitDstStageMask = &stage;
+        vk::assert_success(vk::QueueSubmit(ctx_.game_queue, 1, &submit_info, buf.present_fence));
+
+        ctx_.back_buffers.push(buf);
+        return;
+    }
+
     VkPresentInfoKHR present_info = {};
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     present_info.waitSemaphoreCount = 1;
@@ -547,7 +806,11 @@ void Shell::present_back_buffer() {
     present_info.pImageIndices = &buf.image_index;
 
     // Attempts to present the image
-    VkResult res = vk::QueuePresentKHR(ctx_.present_queue, &present_info);
+    VkResult res;
+    {
+        TraceScope trace("vkQueuePresentKHR");
+        res = vk::QueuePresentKHR(ctx_.present_queue, &present_info);
+    }
 
     // If it is obsolete (out-of-date) or suboptimal, we just ignore this frame (it will be fixed in the next acquiring)
     if (res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR) {
@@ -17,6 +17,7 @@
 #ifndef SHELL_H
 #define SHELL_H
 
+#include <chrono>
 #include <queue>
 #include <vector>
 #include <stdexcept>
@@ -49,10 +50,18 @@ class Shell {
         VkPhysicalDevice physical_dev{};
         uint32_t game_queue_family{};
         uint32_t present_queue_family{};
+        // a transfer-only family when the device has one, for uploads that
+        // overlap graphics work; the game queue family otherwise
+        uint32_t transfer_queue_family{};
 
         VkDevice dev{};
+        // features and optional extensions enabled on dev
+        VkPhysicalDeviceFeatures features{};
+        bool draw_indirect_count{};
+
         VkQueue game_queue{};
         VkQueue present_queue{};
+        VkQueue transfer_queue{};
 
         std::queue<BackBuffer> back_buffers{};
 
@@ -62,6 +71,11 @@ class Shell {
         VkSwapchainKHR swapchain{};
         VkExtent2D extent{};
 
+        // the images rendered to, from the swapchain or offscreen, and the
+        // layout they are left in for presentation
+        std::vector<VkImage> images{};
+        VkImageLayout image_layout{};
+
         BackBuffer acquired_back_buffer{};
     };
     [[nodiscard]] const Context &context() const { return ctx_; }
@@ -93,13 +107,28 @@ class Shell {
     void acquire_back_buffer();
     void present_back_buffer();
 
+    // Acquires, advances the game by the time since the last call and
+    // presents, for the shells that animate.  Logs the present rate and the
+    // game's frame stats every 5 seconds.
+    void animate_frame();
+
     Game &game_;
     const Game::Settings &settings_{};
 
     std::vector<const char *> instance_layers_{};
     std::vector<const char *> instance_extensions_{};
+    // enabled when supported, and then added to instance_extensions_
+    std::vector<const char *> optional_instance_extensions_{};
+    [[nodiscard]] bool has_instance_extension(const char *name) const;
 
     std::vector<const char *> device_extensions_{};
+    // enabled when supported
+    std::vector<const char *> optional_device_extensions_{};
+
+    // Render into a ring of images owned by the shell instead of a swapchain.
+    // Acquiring and presenting then only signal the semaphores and fences, so
+    // no surface or window system is involved.
+    bool offscreen_{};
 
    private:
     bool debug_report_callback(VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT obj_type, uint64_t object, size_t location,
@@ -130,8 +159,25 @@ class Shell {
     void create_swapchain();
     void destroy_swapchain();
 
+    // called by acquire_back_buffer and present_back_buffer, which time them
+    void acquire_image();
+    void present_image();
     void fake_present();
 
+    std::chrono::steady_clock::time_point last_present_{};
+    bool presented_{};
+
+    // kept by animate_frame
+    std::chrono::steady_clock::time_point frame_time_{};
+    std::chrono::steady_clock::time_point profile_start_time_{};
+    int profile_present_count_{};
+
+    void resize_offscreen(uint32_t width_hint, uint32_t height_hint);
+    void destroy_offscreen_images();
+
+    std::vector<VkDeviceMemory> offscreen_mems_{};
+    uint32_t next_offscreen_image_{};
+
     Context ctx_{};
 
     const float game_tick_;
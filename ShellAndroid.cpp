@@ -16,48 +16,12 @@
 
 #include <cassert>
 #include <dlfcn.h>
-#include <time.h>
 #include <android/log.h>
 
 #include "Helpers.h"
 #include "Game.h"
 #include "ShellAndroid.h"
 
-namespace {
-
-// copied from ShellXCB.cpp
-class PosixTimer {
-   public:
-    PosixTimer() { reset(); }
-
-    void reset() { clock_gettime(CLOCK_MONOTONIC, &start_); }
-
-    double get() const {
-        struct timespec now;
-        clock_gettime(CLOCK_MONOTONIC, &now);
-
-        constexpr long one_s_in_ns = 1000 * 1000 * 1000;
-        constexpr double one_s_in_ns_d = static_cast<double>(one_s_in_ns);
-
-        time_t s = now.tv_sec - start_.tv_sec;
-        long ns;
-        if (now.tv_nsec > start_.tv_nsec) {
-            ns = now.tv_nsec - start_.tv_nsec;
-        } else {
-            assert(s > 0);
-            s--;
-            ns = one_s_in_ns - (start_.tv_nsec - now.tv_nsec);
-        }
-
-        return static_cast<double>(s) + static_cast<double>(ns) / one_s_in_ns_d;
-    }
-
-   private:
-    struct timespec start_;
-};
-
-}  // namespace
-
 std::vector<std::string> ShellAndroid::get_args(android_app &app) {
     const char intent_extra_data_key[] = "args";
     std::vector<std::string> args;
@@ -216,10 +180,6 @@ int32_t ShellAndroid::on_input_event(const AInputEvent *event) {
 void ShellAndroid::quit() { ANativeActivity_finish(app_.activity); }
 
 void ShellAndroid::run() {
-    PosixTimer timer;
-
-    double current_time = timer.get();
-
     while (true) {
         struct android_poll_source *source;
         while (true) {
@@ -233,13 +193,6 @@ void ShellAndroid::run() {
 
         if (!app_.window) continue;
 
-        acquire_back_buffer();
-
-        double t = timer.get();
-        add_game_time(static_cast<float>(t - current_time));
-
-        present_back_buffer();
-
-        current_time = t;
+        animate_frame();
     }
 }
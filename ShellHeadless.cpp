@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2016 Google, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <sstream>
+#include <dlfcn.h>
+
+#include "Helpers.h"
+#include "Game.h"
+#include "ShellHeadless.h"
+
+namespace {
+
+    void erase_extension(std::vector<const char *> &exts, const char *name) {
+        exts.erase(std::remove_if(exts.begin(), exts.end(),
+                                  [name](const char *ext) { return std::strcmp(ext, name) == 0; }),
+                   exts.end());
+    }
+
+}  // namespace
+
+ShellHeadless::ShellHeadless(Game &game) : Shell(game) {
+    if (game.settings().validate) instance_layers_.push_back("VK_LAYER_LUNARG_standard_validation");
+
+    // WSI is optional; without it the shell renders offscreen
+    erase_extension(instance_extensions_, VK_KHR_SURFACE_EXTENSION_NAME);
+    erase_extension(device_extensions_, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    optional_instance_extensions_.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+    optional_instance_extensions_.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+
+    init_vk();
+    select_mode();
+}
+
+ShellHeadless::~ShellHeadless() {
+    cleanup_vk();
+    dlclose(lib_handle_);
+}
+
+void ShellHeadless::select_mode() {
+    offscreen_ = true;
+
+    if (has_instance_extension(VK_KHR_SURFACE_EXTENSION_NAME) &&
+        has_instance_extension(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME)) {
+        std::vector<VkExtensionProperties> exts;
+        vk::enumerate(context().physical_dev, nullptr, exts);
+
+        for (const auto &ext: exts) {
+            if (std::strcmp(ext.extensionName, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0) offscreen_ = false;
+        }
+    }
+
+    if (!offscreen_) device_extensions_.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+    log(LOG_INFO, offscreen_ ? "headless: rendering to offscreen images" : "headless: presenting to a headless surface");
+}
+
+PFN_vkGetInstanceProcAddr ShellHeadless::load_vk() {
+    const char filename[] = "libvulkan.so.1";
+    void *handle, *symbol;
+
+#ifdef UNINSTALLED_LOADER
+    handle = dlopen(UNINSTALLED_LOADER, RTLD_LAZY);
+    if (!handle) handle = dlopen(filename, RTLD_LAZY);
+#else
+    handle = dlopen(filename, RTLD_LAZY);
+#endif
+
+    if (handle) symbol = dlsym(handle, "vkGetInstanceProcAddr");
+
+    if (!handle || !symbol) {
+        std::stringstream ss;
+        ss << "failed to load " << dlerror();
+
+        if (handle) dlclose(handle);
+
+        throw std::runtime_error(ss.str());
+    }
+
+    lib_handle_ = handle;
+
+    return reinterpret_cast<PFN_vkGetInstanceProcAddr>(symbol);
+}
+
+VkSurfaceKHR ShellHeadless::create_surface(VkInstance instance) {
+    VkHeadlessSurfaceCreateInfoEXT surface_info = {};
+    surface_info.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+
+    VkSurfaceKHR surface;
+    vk::assert_success(vk::CreateHeadlessSurfaceEXT(instance, &surface_info, nullptr, &surface));
+
+    return surface;
+}
+
+void ShellHeadless::run() {
+    create_context();
+    resize_swapchain(settings_.initial_width, settings_.initial_height);
+
+    // there are no events to wait for, so always animate; --c bounds the run
+    quit_ = false;
+    while (!quit_) animate_frame();
+
+    destroy_context();
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2016 Google, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SHELL_HEADLESS_H
+#define SHELL_HEADLESS_H
+
+#include "Shell.h"
+
+// Runs without a window.  Presents to a VK_EXT_headless_surface swapchain when
+// the driver has one, and otherwise renders into offscreen images, so that it
+// also works against software implementations such as lavapipe.
+class ShellHeadless : public Shell {
+   public:
+    explicit ShellHeadless(Game &game);
+    ~ShellHeadless() override;
+
+    void run() override;
+    void quit() override { quit_ = true; }
+
+   private:
+    PFN_vkGetInstanceProcAddr load_vk() override;
+    bool can_present(VkPhysicalDevice phy, uint32_t queue_family) override { return true; }
+    VkSurfaceKHR create_surface(VkInstance instance) override;
+
+    // picks the headless surface or offscreen images after init_vk
+    void select_mode();
+
+    void *lib_handle_{};
+
+    bool quit_{};
+};
+
+#endif  // SHELL_HEADLESS_H
@@ -17,14 +17,12 @@
 #include <cassert>
 #include <dlfcn.h>
 #include <sstream>
-#include <ctime>
 
 #include "Game.h"
 #include "Helpers.h"
 #include "ShellWayland.h"
 #include <cstring>
 #include <linux/input.h>
-#include <iomanip>
 
 /* Unused attribute / variable MACRO.
    Some methods of classes' heirs do not need all future parameters.
@@ -36,39 +34,6 @@
 #define UNUSED
 #endif
 
-namespace {
-    class PosixTimer {
-    public:
-        PosixTimer() { reset(); }
-
-        void reset() { clock_gettime(CLOCK_MONOTONIC, &start_); }
-
-        [[nodiscard]] double get() const {
-            struct timespec now{};
-            clock_gettime(CLOCK_MONOTONIC, &now);
-
-            constexpr long one_s_in_ns = 1000 * 1000 * 1000;
-            constexpr auto one_s_in_ns_d = static_cast<double>(one_s_in_ns);
-
-            time_t s = now.tv_sec - start_.tv_sec;
-            long ns;
-            if (now.tv_nsec > start_.tv_nsec) {
-                ns = now.tv_nsec - start_.tv_nsec;
-            } else {
-                assert(s > 0);
-                s--;
-                ns = one_s_in_ns - (start_.tv_nsec - now.tv_nsec);
-            }
-
-            return static_cast<double>(s) + static_cast<double>(ns) / one_s_in_ns_d;
-        }
-
-    private:
-        struct timespec start_{};
-    };
-
-}  // namespace
-
 void ShellWayland::handle_xdg_wm_base_ping(void *data, struct xdg_wm_base *xdg_wm_base, uint32_t serial) {
     (void) data;
     xdg_wm_base_pong(xdg_wm_base, serial);
@@ -375,38 +340,12 @@ void ShellWayland::loop_wait() {
 }
 
 void ShellWayland::loop_poll() {
-    PosixTimer timer;
-
-    double current_time = timer.get();
-    double profile_start_time = current_time;
-    int profile_present_count = 0;
-
     while (true) {
         if (quit_) break;
 
         wl_display_dispatch_pending(display_);
 
-        acquire_back_buffer();
-
-        double t = timer.get();
-        add_game_time(static_cast<float>(t - current_time));
-
-        present_back_buffer();
-
-        current_time = t;
-
-        profile_present_count++;
-        if (current_time - profile_start_time >= 5.0) {
-            const double fps = profile_present_count / (current_time - profile_start_time);
-            std::stringstream ss;
-            ss << std::right << std::setw(5) << profile_present_count << " presents in "
-               << std::left << std::setw(7) << current_time - profile_start_time << " seconds "
-               << "(FPS: " << std::left << std::setw(7) << fps << ")";
-            log(LOG_INFO, ss.str().c_str());
-
-            profile_start_time = current_time;
-            profile_present_count = 0;
-        }
+        animate_frame();
     }
 }
 
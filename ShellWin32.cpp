@@ -22,34 +22,6 @@
 #include "Game.h"
 #include "ShellWin32.h"
 
-namespace {
-
-class Win32Timer {
-   public:
-    Win32Timer() {
-        LARGE_INTEGER freq;
-        QueryPerformanceFrequency(&freq);
-        freq_ = static_cast<double>(freq.QuadPart);
-
-        reset();
-    }
-
-    void reset() { QueryPerformanceCounter(&start_); }
-
-    double get() const {
-        LARGE_INTEGER now;
-        QueryPerformanceCounter(&now);
-
-        return static_cast<double>(now.QuadPart - start_.QuadPart) / freq_;
-    }
-
-   private:
-    double freq_;
-    LARGE_INTEGER start_;
-};
-
-}  // namespace
-
 ShellWin32::ShellWin32(Game &game) : Shell(game), hwnd_(nullptr) {
     if (game.settings().validate) instance_layers_.push_back("VK_LAYER_LUNARG_standard_validation");
     instance_extensions_.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
@@ -179,9 +151,6 @@ void ShellWin32::run() {
     create_context();
     resize_swapchain(settings_.initial_width, settings_.initial_height);
 
-    Win32Timer timer;
-    double current_time = timer.get();
-
     while (true) {
         bool quit = false;
 
@@ -201,14 +170,7 @@ void ShellWin32::run() {
 
         if (quit) break;
 
-        acquire_back_buffer();
-
-        double t = timer.get();
-        add_game_time(static_cast<float>(t - current_time));
-
-        present_back_buffer();
-
-        current_time = t;
+        animate_frame();
     }
 
     destroy_context();
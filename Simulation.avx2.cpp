@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2016 Google, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This file is compiled with AVX2 enabled.  Only call into it after checking
+// the CPU at runtime.
+
+#include "Simulation.kernels.h"
+
+#if defined(__AVX2__)
+
+void interpolate_transforms_avx2(const TransformStreams &streams, float alpha, int begin, int end) {
+    interpolate_transforms<Avx2Lanes>(streams, alpha, begin, end);
+}
+
+int cull_spheres_avx2(const CullStreams &streams, int begin, int end, uint8_t *visible) {
+    return cull_spheres<Avx2Lanes>(streams, begin, end, visible);
+}
+
+void update_orientations_avx2(const OrientationStreams &streams, float time, int begin, int end) {
+    update_orientations<Avx2DoubleLanes>(streams, time, begin, end);
+}
+
+#endif  // __AVX2__
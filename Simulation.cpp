@@ -14,36 +14,61 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <array>
+#include <thread>
 #include <glm/gtc/matrix_transform.hpp>
 #include "Simulation.h"
+#include "Simulation.kernels.h"
 
 namespace {
 
+// Stream ids for CounterRng
+enum RngStream {
+    RNG_COLOR,
+    RNG_ANIMATION,
+    RNG_PATH,
+};
+
+// sin and cos from basic arithmetic only, so that the results do not depend
+// on the C library
+void portable_sincos(float x, float &s, float &c) {
+    double sd, cd;
+    sincos_lanes<ScalarDoubleLanes>(x, &sd, &cd);
+    s = static_cast<float>(sd);
+    c = static_cast<float>(cd);
+}
+
+// Picks meshes in proportion to their weights, spreading each type evenly
+// over the sequence (smooth weighted round-robin).  The sequence repeats
+// every sum-of-weights objects, so it is precomputed once and indexed.
 class MeshPicker {
    public:
-    MeshPicker()
-        : pattern_({{
-              Meshes::MESH_PYRAMID,
-              Meshes::MESH_ICOSPHERE,
-              Meshes::MESH_TEAPOT,
-              Meshes::MESH_PYRAMID,
-              Meshes::MESH_ICOSPHERE,
-              Meshes::MESH_PYRAMID,
-              Meshes::MESH_PYRAMID,
-              Meshes::MESH_PYRAMID,
-              Meshes::MESH_PYRAMID,
-              Meshes::MESH_PYRAMID,
-          }}),
-          cur_(-1) {}
-
-    Meshes::Type pick() {
-        cur_ = int((cur_ + 1) % pattern_.size());
-        return pattern_[cur_];
+    explicit MeshPicker(const std::vector<int> &mix) {
+        assert(mix.size() == Meshes::MESH_COUNT);
+
+        int total = 0;
+        for (int weight : mix) total += weight;
+        assert(total > 0);
+
+        std::array<int, Meshes::MESH_COUNT> credits{};
+        pattern_.reserve(total);
+        for (int n = 0; n < total; n++) {
+            int best = 0;
+            for (int i = 0; i < Meshes::MESH_COUNT; i++) {
+                credits[i] += mix[i];
+                if (credits[i] > credits[best]) best = i;
+            }
+            credits[best] -= total;
+
+            pattern_.push_back(static_cast<Meshes::Type>(best));
+        }
     }
 
+    [[nodiscard]] const std::vector<Meshes::Type> &pattern() const { return pattern_; }
+
     [[nodiscard]] static float scale(Meshes::Type type) {
         float base = 0.005f;
 
@@ -59,224 +84,413 @@ class MeshPicker {
     }
 
    private:
-    const std::array<Meshes::Type, 10> pattern_{};
-    int cur_{0};
+    std::vector<Meshes::Type> pattern_{};
 };
 
 class ColorPicker {
    public:
-    explicit ColorPicker(unsigned int rng_seed) : rng_(rng_seed), red_(0.0f, 1.0f), green_(0.0f, 1.0f), blue_(0.0f, 1.0f) {}
+    explicit ColorPicker(const CounterRng &rng) : rng_(rng) {}
 
-    glm::vec3 pick() { return glm::vec3{red_(rng_), green_(rng_), blue_(rng_)}; }
+    glm::vec3 pick() {
+        float red = rng_.uniform(0.0f, 1.0f);
+        float green = rng_.uniform(0.0f, 1.0f);
+        float blue = rng_.uniform(0.0f, 1.0f);
+        return glm::vec3{red, green, blue};
+    }
 
    private:
-    std::mt19937 rng_;
-    std::uniform_real_distribution<float> red_;
-    std::uniform_real_distribution<float> green_;
-    std::uniform_real_distribution<float> blue_;
+    CounterRng rng_;
 };
 
-}  // namespace
-
-Animation::Animation(unsigned int rng_seed, float scale) : rng_(rng_seed), dir_(-1.0f, 1.0f), speed_(0.1f, 1.0f) {
-    float x = dir_(rng_);
-    float y = dir_(rng_);
-    float z = dir_(rng_);
-    if (std::abs(x) + std::abs(y) + std::abs(z) == 0.0f) x = 1.0f;
-
-    current_.axis = glm::normalize(glm::vec3(x, y, z));
-
-    current_.speed = speed_(rng_);
-    current_.scale = scale;
-
-    current_.matrix = glm::scale(glm::mat4(1.0f), glm::vec3(current_.scale));
-}
-
-glm::mat4 Animation::transformation(float t) {
-    current_.matrix = glm::rotate(current_.matrix, current_.speed * t, current_.axis);
-
-    return current_.matrix;
-}
-
-class Curve {
+class AnimationPicker {
    public:
-    virtual ~Curve() = default;
-    virtual glm::vec3 evaluate(float t) = 0;
-};
+    explicit AnimationPicker(const CounterRng &rng) : rng_(rng) {}
 
-namespace {
-
-enum CurveType {
-    CURVE_RANDOM,
-    CURVE_CIRCLE,
-    CURVE_COUNT,
-};
+    glm::vec3 pick_axis() {
+        float x = rng_.uniform(-1.0f, 1.0f);
+        float y = rng_.uniform(-1.0f, 1.0f);
+        float z = rng_.uniform(-1.0f, 1.0f);
+        if (std::abs(x) + std::abs(y) + std::abs(z) == 0.0f) x = 1.0f;
 
-class RandomCurve : public Curve {
-   public:
-    explicit RandomCurve(unsigned int rng_seed)
-        : rng_(rng_seed),
-          direction_(-0.3f, 0.3f),
-          duration_(1.0f, 5.0f),
-          segment_start_(0.0f),
-          segment_direction_(0.0f),
-          time_start_(0.0f),
-          time_duration_(0.0f) {}
-
-    glm::vec3 evaluate(float t) override {
-        if (t >= time_start_ + time_duration_) new_segment(t);
-
-        pos_ += unit_dir_ * (t - last_);
-        last_ = t;
-
-        return pos_;
+        return glm::normalize(glm::vec3(x, y, z));
     }
 
+    float pick_speed() { return rng_.uniform(0.1f, 1.0f); }
+
    private:
-    void new_segment(float time_start) {
-        segment_start_ += segment_direction_;
-        segment_direction_ = glm::vec3(direction_(rng_), direction_(rng_), direction_(rng_));
+    CounterRng rng_;
+};
 
-        time_start_ = time_start;
-        time_duration_ = duration_(rng_);
+#if defined(SIMULATION_AVX2)
+bool cpu_has_avx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+
+    // AVX2 also needs the OS to save the YMM registers
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
 
-        unit_dir_ = segment_direction_ / time_duration_;
-        pos_ = segment_start_;
-        last_ = time_start_;
+InterpolateTransformsFunc select_interpolate_transforms(const char *&name) {
+#if defined(SIMULATION_AVX2)
+    if (cpu_has_avx2()) {
+        name = "avx2";
+        return interpolate_transforms_avx2;
     }
+#endif
+
+#if defined(SIMULATION_SSE2)
+    name = "sse2";
+    return interpolate_transforms<SseLanes>;
+#elif defined(SIMULATION_NEON)
+    name = "neon";
+    return interpolate_transforms<NeonLanes>;
+#else
+    name = "scalar";
+    return interpolate_transforms<ScalarLanes>;
+#endif
+}
 
-    std::mt19937 rng_;
-    std::uniform_real_distribution<float> direction_;
-    std::uniform_real_distribution<float> duration_;
-
-    glm::vec3 segment_start_;
-    glm::vec3 segment_direction_;
-    float time_start_;
-    float time_duration_;
-
-    glm::vec3 unit_dir_{};
-    glm::vec3 pos_{};
-    float last_{};
-};
+UpdateOrientationsFunc select_update_orientations() {
+#if defined(SIMULATION_AVX2)
+    if (cpu_has_avx2()) return update_orientations_avx2;
+#endif
+
+#if defined(SIMULATION_SSE2)
+    return update_orientations<SseDoubleLanes>;
+#elif defined(SIMULATION_NEON_DOUBLE)
+    return update_orientations<NeonDoubleLanes>;
+#else
+    return update_orientations<ScalarDoubleLanes>;
+#endif
+}
 
-class CircleCurve : public Curve {
-   public:
-    CircleCurve(float radius, glm::vec3 axis) : r_(radius) {
-        glm::vec3 a;
-
-        if (axis.x != 0.0f) {
-            a.x = -axis.z / axis.x;
-            a.y = 0.0f;
-            a.z = 1.0f;
-        } else if (axis.y != 0.0f) {
-            a.x = 1.0f;
-            a.y = -axis.x / axis.y;
-            a.z = 0.0f;
-        } else {
-            a.x = 1.0f;
-            a.y = 0.0f;
-            a.z = -axis.x / axis.z;
-        }
+CullSpheresFunc select_cull_spheres() {
+#if defined(SIMULATION_AVX2)
+    if (cpu_has_avx2()) return cull_spheres_avx2;
+#endif
+
+#if defined(SIMULATION_SSE2)
+    return cull_spheres<SseLanes>;
+#elif defined(SIMULATION_NEON)
+    return cull_spheres<NeonLanes>;
+#else
+    return cull_spheres<ScalarLanes>;
+#endif
+}
 
-        a_ = glm::normalize(a);
-        b_ = glm::normalize(glm::cross(a_, axis));
-    }
+glm::vec3 load_vec3(const float *v) { return {v[0], v[1], v[2]}; }
 
-    glm::vec3 evaluate(float t) override {
-        return (a_ * (glm::vec3(std::cos(t)) - glm::vec3(1.0f)) + b_ * glm::vec3(std::sin(t))) * glm::vec3(r_);
-    }
+void store_vec3(float *v, const glm::vec3 &value) {
+    v[0] = value.x;
+    v[1] = value.y;
+    v[2] = value.z;
+}
 
-   private:
-    float r_;
-    glm::vec3 a_{};
-    glm::vec3 b_{};
-};
+// offset from the subpath origin at subpath time t
+glm::vec3 circle_position(const Path &path, float t) {
+    float s, c;
+    portable_sincos(t, s, c);
+    return (load_vec3(path.circle.a) * (c - 1.0f) + load_vec3(path.circle.b) * s) * path.circle.radius;
+}
 
-}  // namespace
+// offset from the subpath origin at subpath time t; a segment that has run
+// out stops at its end until advance_random_segments() starts the next one
+glm::vec3 random_position(const Path &path, float t) {
+    const auto &random = path.random;
+    const float elapsed = t - random.time_start;
+    if (elapsed >= random.time_duration) return load_vec3(random.segment_start) + load_vec3(random.segment_direction);
 
-Path::Path(unsigned int rng_seed) : rng_(rng_seed), type_(0, CURVE_COUNT - 1), duration_(5.0f, 20.0f) {
-    // trigger a subpath generation
-    current_.end = -1.0f;
-    current_.now = 0.0f;
+    return load_vec3(random.segment_start) + load_vec3(random.segment_direction) * (elapsed / random.time_duration);
 }
 
-glm::vec3 Path::position(float t) {
-    current_.now += t;
+void new_random_segment(Path &path, float time_start) {
+    auto &random = path.random;
+    for (int k = 0; k < 3; k++) random.segment_start[k] += random.segment_direction[k];
+    for (int k = 0; k < 3; k++) random.segment_direction[k] = path.curve_rng.uniform(-0.3f, 0.3f);
 
-    while (current_.now >= current_.end) generate_subpath();
-
-    return current_.origin + current_.curve->evaluate(current_.now - current_.start);
+    random.time_start = time_start;
+    random.time_duration = path.curve_rng.uniform(1.0f, 5.0f);
 }
 
-void Path::generate_subpath() {
-    float duration = duration_(rng_);
-    auto type = static_cast<CurveType>(type_(rng_));
+// starts the segments of a random subpath up to subpath time t, each one
+// where the previous one ended, so that the segments do not depend on how
+// the time is stepped
+void advance_random_segments(Path &path, float t) {
+    while (t >= path.random.time_start + path.random.time_duration)
+        new_random_segment(path, path.random.time_start + path.random.time_duration);
+}
 
-    if (current_.curve) {
-        current_.origin += current_.curve->evaluate(current_.end - current_.start);
-        current_.origin = glm::mod(current_.origin, glm::vec3(2.0f));
-        current_.start = current_.end;
+void generate_subpath(Path &path, CounterRng &rng) {
+    float duration = rng.uniform(5.0f, 20.0f);
+    auto type = static_cast<Path::Curve>(rng.next() % Path::CURVE_COUNT);
+
+    if (path.curve != Path::CURVE_NONE) {
+        const float t = path.end - path.start;
+        if (path.curve == Path::CURVE_RANDOM) advance_random_segments(path, t);
+        glm::vec3 origin = load_vec3(path.origin);
+        origin += (path.curve == Path::CURVE_CIRCLE) ? circle_position(path, t) : random_position(path, t);
+        store_vec3(path.origin, glm::mod(origin, glm::vec3(2.0f)));
+        path.start = path.end;
     } else {
-        std::uniform_real_distribution<float> origin(0.0f, 2.0f);
-        current_.origin = glm::vec3(origin(rng_), origin(rng_), origin(rng_));
-        current_.start = current_.now;
+        float x = rng.uniform(0.0f, 2.0f);
+        float y = rng.uniform(0.0f, 2.0f);
+        float z = rng.uniform(0.0f, 2.0f);
+        store_vec3(path.origin, glm::vec3(x, y, z));
+        // at the start of the clock, however far the first update steps
+        path.start = 0.0f;
     }
 
-    current_.end = current_.start + duration;
+    path.end = path.start + duration;
+    path.curve = type;
 
     switch (type) {
-        case CURVE_RANDOM:
-            curve = new RandomCurve(rng_());
+        case Path::CURVE_RANDOM:
+            // the first segment starts with the subpath
+            path.random = {};
+            path.curve_rng = rng.fork(Path::CURVE_RANDOM);
             break;
-        case CURVE_CIRCLE: {
-            std::uniform_real_distribution<float> dir(-1.0f, 1.0f);
-            glm::vec3 axis(dir(rng_), dir(rng_), dir(rng_));
+        case Path::CURVE_CIRCLE: {
+            float x = rng.uniform(-1.0f, 1.0f);
+            float y = rng.uniform(-1.0f, 1.0f);
+            float z = rng.uniform(-1.0f, 1.0f);
+            glm::vec3 axis(x, y, z);
             if (axis.x == 0.0f && axis.y == 0.0f && axis.z == 0.0f) axis.x = 1.0f;
 
-            std::uniform_real_distribution<float> radius_(0.02f, 0.2f);
-            curve = new CircleCurve(radius_(rng_), axis);
+            path.circle.radius = rng.uniform(0.02f, 0.2f);
+
+            // a and b span the plane of the circle
+            glm::vec3 a;
+            if (axis.x != 0.0f) {
+                a.x = -axis.z / axis.x;
+                a.y = 0.0f;
+                a.z = 1.0f;
+            } else if (axis.y != 0.0f) {
+                a.x = 1.0f;
+                a.y = -axis.x / axis.y;
+                a.z = 0.0f;
+            } else {
+                a.x = 1.0f;
+                a.y = 0.0f;
+                a.z = -axis.x / axis.z;
+            }
+            a = glm::normalize(a);
+            store_vec3(path.circle.a, a);
+            store_vec3(path.circle.b, glm::normalize(glm::cross(a, axis)));
         } break;
         default:
-            curve = nullptr;
             assert(!"unreachable");
     }
+}
+
+// moves the path clock by t and starts the subpaths and segments it reaches;
+// the branchy part of an update, kept apart from the evaluation loops
+void advance_path(Path &path, float t, CounterRng &rng) {
+    path.now += t;
+
+    while (path.now >= path.end) generate_subpath(path, rng);
 
-    current_.curve.reset(curve);
+    if (path.curve == Path::CURVE_RANDOM) advance_random_segments(path, path.now - path.start);
 }
 
-Simulation::Simulation(int object_count) : random_dev_() {
-    MeshPicker mesh;
-    ColorPicker color(random_dev_());
+}  // namespace
+
+Simulation::Simulation(int object_count, const std::vector<int> &mesh_mix, unsigned int seed) : seed_(seed) {
+    meshes_.resize(object_count);
+    light_positions_.resize(object_count);
+    light_colors_.resize(object_count);
+    frame_data_offsets_.resize(object_count);
+    radii_.resize(object_count);
+    scales_.resize(object_count);
+
+    for (auto &slot : positions_) {
+        for (auto &stream : slot) stream.resize(object_count);
+    }
+    for (auto &slot : orientations_) {
+        for (int k = 0; k < 4; k++) slot[k].resize(object_count, k == 3 ? 1.0f : 0.0f);
+    }
+    for (auto &stream : axes_) stream.resize(object_count);
+    speeds_.resize(object_count);
+    times_.resize(object_count);
+    paths_.resize(object_count);
+    path_rngs_.resize(object_count);
+    for (auto &stream : centers_) stream.resize(object_count);
+    models_.resize(object_count);
+
+    // objects only depend on the seed and their index
+    const MeshPicker mesh(mesh_mix);
+    const int thread_count = std::min(static_cast<int>(std::thread::hardware_concurrency()), object_count / 16384);
+    if (thread_count > 1) {
+        std::vector<std::thread> threads;
+        threads.reserve(thread_count);
+        for (int t = 0; t < thread_count; t++) {
+            const int begin = static_cast<int>(static_cast<int64_t>(object_count) * t / thread_count);
+            const int end = static_cast<int>(static_cast<int64_t>(object_count) * (t + 1) / thread_count);
+            threads.emplace_back([this, begin, end, &mesh] { init_objects(begin, end, mesh.pattern()); });
+        }
+        for (auto &thread : threads) thread.join();
+    } else {
+        init_objects(0, object_count, mesh.pattern());
+    }
+
+    streams_.scale = scales_.data();
+    for (int k = 0; k < 3; k++) streams_.center[k] = centers_[k].data();
+    streams_.models = reinterpret_cast<float *>(models_.data());
+    bind_streams();
+
+    interpolate_transforms_ = select_interpolate_transforms(kernel_name_);
+    cull_spheres_ = select_cull_spheres();
+    update_orientations_ = select_update_orientations();
+}
 
-    objects_.reserve(object_count);
-    for (int i = 0; i < object_count; i++) {
-        Meshes::Type type = mesh.pick();
+void Simulation::init_objects(int begin, int end, const std::vector<Meshes::Type> &mesh_pattern) {
+    const int count = object_count();
+
+    for (int i = begin; i < end; i++) {
+        Meshes::Type type = mesh_pattern[i % mesh_pattern.size()];
         float scale = MeshPicker::scale(type);
 
-        objects_.emplace_back(Object{
-            type,
-            glm::vec3(0.5f + 0.5f * (float)i / (float)object_count),
-            color.pick(),
-            Animation(random_dev_(), scale),
-            Path(random_dev_()),
-        });
+        meshes_[i] = type;
+        scales_[i] = scale;
+        light_positions_[i] = glm::vec3(0.5f + 0.5f * (float)i / (float)count);
+        light_colors_[i] = ColorPicker(CounterRng(seed_, i, RNG_COLOR)).pick();
+
+        AnimationPicker animation(CounterRng(seed_, i, RNG_ANIMATION));
+        const glm::vec3 axis = animation.pick_axis();
+        for (int k = 0; k < 3; k++) axes_[k][i] = axis[k];
+        speeds_[i] = animation.pick_speed();
+
+        path_rngs_[i] = CounterRng(seed_, i, RNG_PATH);
+    }
+}
+
+void Simulation::bind_streams() {
+    const int slots[2] = {slot(2), front_};
+    for (int t = 0; t < 2; t++) {
+        for (int k = 0; k < 3; k++) streams_.position[t][k] = positions_[slots[t]][k].data();
+        for (int k = 0; k < 4; k++) streams_.orientation[t][k] = orientations_[slots[t]][k].data();
     }
 }
 
 void Simulation::set_frame_data_size(uint32_t size) {
     uint32_t offset = 0;
-    for (auto &obj : objects_) {
-        obj.frame_data_offset = offset;
+    for (auto &frame_data_offset : frame_data_offsets_) {
+        frame_data_offset = offset;
         offset += size;
     }
 }
 
+void Simulation::set_transform_output(TransformOutput output) {
+    if (output == OUTPUT_POSES) {
+        models_.clear();
+        poses_.resize(meshes_.size());
+    } else {
+        poses_.clear();
+        models_.resize(meshes_.size());
+    }
+
+    streams_.models = models_.empty() ? nullptr : reinterpret_cast<float *>(models_.data());
+    streams_.poses = poses_.empty() ? nullptr : reinterpret_cast<float *>(poses_.data());
+}
+
+void Simulation::set_mesh_radii(const std::array<float, Meshes::MESH_COUNT> &radii) {
+    for (size_t i = 0; i < meshes_.size(); i++) radii_[i] = radii[meshes_[i]] * MeshPicker::scale(meshes_[i]);
+}
+
+int Simulation::cull(const std::array<glm::vec4, 6> &planes, int begin, int end, uint8_t *visible) const {
+    CullStreams streams{};
+    for (int k = 0; k < 3; k++) streams.center[k] = centers_[k].data();
+    streams.radius = radii_.data();
+    for (int p = 0; p < 6; p++) {
+        for (int k = 0; k < 4; k++) streams.planes[p][k] = planes[p][k];
+    }
+
+    return cull_spheres_(streams, begin, end, visible);
+}
+
 void Simulation::update(float time, int begin, int end) {
-    for (int i = begin; i < end; i++) {
-        auto &obj = objects_[i];
+    auto &positions = positions_[slot(1)];
+
+    // Advance a block of paths, then evaluate the circles and the random
+    // segments of the block in one loop each.
+    constexpr int block_size = 64;
+    std::array<int, block_size> circles;
+    std::array<int, block_size> randoms;
+    for (int block = begin; block < end; block += block_size) {
+        const int block_end = std::min(block + block_size, end);
+
+        int circle_count = 0;
+        int random_count = 0;
+        for (int i = block; i < block_end; i++) {
+            advance_path(paths_[i], time, path_rngs_[i]);
+
+            if (paths_[i].curve == Path::CURVE_CIRCLE)
+                circles[circle_count++] = i;
+            else
+                randoms[random_count++] = i;
+        }
+
+        for (int n = 0; n < circle_count; n++) {
+            const int i = circles[n];
+            const Path &path = paths_[i];
+            const glm::vec3 pos = load_vec3(path.origin) + circle_position(path, path.now - path.start);
+            for (int k = 0; k < 3; k++) positions[k][i] = pos[k];
+        }
 
-        glm::vec3 pos = obj.path.position(time);
-        glm::mat4 trans = obj.animation.transformation(time);
-        obj.model = glm::translate(glm::mat4(1.0f), pos) * trans;
+        for (int n = 0; n < random_count; n++) {
+            const int i = randoms[n];
+            const Path &path = paths_[i];
+            const glm::vec3 pos = load_vec3(path.origin) + random_position(path, path.now - path.start);
+            for (int k = 0; k < 3; k++) positions[k][i] = pos[k];
+        }
+    }
+
+    OrientationStreams streams{};
+    streams.time = times_.data();
+    streams.speed = speeds_.data();
+    for (int k = 0; k < 3; k++) streams.axis[k] = axes_[k].data();
+    for (int k = 0; k < 4; k++) streams.orientation[k] = orientations_[slot(1)][k].data();
+    update_orientations_(streams, time, begin, end);
+}
+
+void Simulation::swap_buffers() {
+    front_ = slot(1);
+
+    // the first tick has nothing to be blended from
+    if (!published_) {
+        for (int k = 0; k < 3; k++) positions_[slot(2)][k] = positions_[front_][k];
+        for (int k = 0; k < 4; k++) orientations_[slot(2)][k] = orientations_[front_][k];
+        published_ = true;
     }
+
+    bind_streams();
+}
+
+void Simulation::interpolate(float alpha, int begin, int end) { interpolate_transforms_(streams_, alpha, begin, end); }
+
+uint64_t Simulation::state_hash() const {
+    // FNV-1a over the published tick
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto hash_stream = [&hash](const std::vector<float> &stream) {
+        const auto *bytes = reinterpret_cast<const uint8_t *>(stream.data());
+        const size_t size = sizeof(stream[0]) * stream.size();
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+    };
+    for (const auto &stream : positions_[front_]) hash_stream(stream);
+    for (const auto &stream : orientations_[front_]) hash_stream(stream);
+
+    return hash;
 }
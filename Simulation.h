@@ -17,90 +17,226 @@
 #ifndef SIMULATION_H
 #define SIMULATION_H
 
+#include <array>
+#include <cstdint>
 #include <memory>
-#include <random>
 #include <vector>
 
 #include <glm/glm.hpp>
 
 #include "Meshes.h"
 
-class Animation {
+// Counter-based generator.  The n-th value of a stream is a hash of the
+// stream key and n, so every object's streams can be derived from the seed
+// and the object index alone, in any order and on any thread.  Values are
+// converted to floats by hand so that they do not depend on the standard
+// library.
+class CounterRng {
    public:
-    Animation(unsigned rng_seed, float scale);
+    CounterRng() = default;
+    CounterRng(uint64_t seed, uint64_t object, uint64_t stream)
+        : key_(mix(mix(seed + 0x9e3779b97f4a7c15ull * (object + 1)) ^ stream)) {}
 
-    glm::mat4 transformation(float t);
+    uint32_t next() { return static_cast<uint32_t>(mix(key_ + 0x9e3779b97f4a7c15ull * ++counter_) >> 32); }
 
-   private:
-    struct Data {
-        glm::vec3 axis;
-        float speed;
-        float scale;
+    // uniform in [lo, hi)
+    float uniform(float lo, float hi) {
+        return lo + (hi - lo) * (static_cast<float>(next() >> 8) * (1.0f / 16777216.0f));
+    }
 
-        glm::mat4 matrix;
-    };
+    // a new independent stream, e.g. for a sub-object
+    CounterRng fork(uint64_t stream) { return {key_, counter_++, stream}; }
 
-    std::mt19937 rng_;
-    std::uniform_real_distribution<float> dir_;
-    std::uniform_real_distribution<float> speed_;
+   private:
+    // splitmix64 finalizer
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t key_{};
+    uint64_t counter_{};
+};
 
-    Data current_{};
+// Per-object transform state of the previous and the current tick, one stream
+// per component, and the blended outputs.  Streams are indexed by object and
+// orientation is a unit quaternion (x, y, z, w).
+struct TransformStreams {
+    const float *position[2][3];
+    const float *orientation[2][4];
+    const float *scale;
+
+    float *center[3];
+    float *models;  // column-major 4x4 per object, or null
+    float *poses;   // see Pose, or null
 };
 
-class Curve;
+// an object's transform as position, uniform scale and unit quaternion
+// (x, y, z, w), which packs smaller than the matrix
+struct Pose {
+    glm::vec3 position;
+    float scale;
+    glm::vec4 orientation;
+};
+static_assert(sizeof(Pose) == 8 * sizeof(float), "the kernels write poses as 8 floats");
 
-class Path {
-   public:
-    explicit Path(unsigned rng_seed);
+// alpha is 0 at the previous tick and 1 at the current one
+using InterpolateTransformsFunc = void (*)(const TransformStreams &streams, float alpha, int begin, int end);
 
-    glm::vec3 position(float t);
+// Bounding spheres, one stream per component, and the planes they are tested
+// against.  Planes are normalized and face inward.
+struct CullStreams {
+    const float *center[3];
+    const float *radius;
 
-   private:
-    struct Subpath {
-        glm::vec3 origin;
-        float start;
-        float end;
-        float now;
+    float planes[6][4];
+};
 
-        std::shared_ptr<Curve> curve{};
-    };
+// writes visible[i - begin] for each object and returns the visible count
+using CullSpheresFunc = int (*)(const CullStreams &streams, int begin, int end, uint8_t *visible);
 
-    void generate_subpath();
+// Per-object clocks and rotations, one stream per component.  update()
+// writes the orientations of the tick being stepped.
+struct OrientationStreams {
+    double *time;
+    const float *speed;
+    const float *axis[3];
 
-    std::mt19937 rng_;
-    std::uniform_int_distribution<> type_{};
-    std::uniform_real_distribution<float> duration_{};
+    float *orientation[4];
+};
+
+// advances the clocks by time seconds and writes the orientations at the new time
+using UpdateOrientationsFunc = void (*)(const OrientationStreams &streams, float time, int begin, int end);
+
+// An object's path is a chain of subpaths, each a curve relative to the
+// subpath's origin.  The curve is a tagged union rather than a polymorphic
+// object so that paths are stored flat and never allocate.
+struct Path {
+    enum Curve : uint32_t {
+        CURVE_RANDOM,
+        CURVE_CIRCLE,
+        CURVE_COUNT,
+        // before the first subpath
+        CURVE_NONE = CURVE_COUNT,
+    };
 
-    Subpath current_{};
-    Curve *curve{};
+    Curve curve{CURVE_NONE};
+    float origin[3]{};
+    // subpath start and end on the path's clock
+    float start{};
+    float end{-1.0f};
+    float now{};
+
+    union {
+        // straight segments in random directions, times in subpath time
+        struct {
+            float segment_start[3];
+            float segment_direction[3];
+            float time_start;
+            float time_duration;
+        } random;
+        // a circle through the origin, spanned by a and b
+        struct {
+            float radius;
+            float a[3];
+            float b[3];
+        } circle;
+    };
+    // draws the random segments
+    CounterRng curve_rng{};
 };
 
+// Objects are stored as a structure of arrays so that update() and the draw
+// loop only stride over the fields they touch.
+//
+// Positions and orientations are kept for the last two published ticks and
+// the one being stepped.  update() writes the back slot while interpolate()
+// blends the other two, so a tick can be simulated while the previous one is
+// drawn.  swap_buffers() publishes the tick once every range has been updated.
 class Simulation {
    public:
-    explicit Simulation(int object_count);
+    // mesh_mix holds the relative weight of each Meshes::Type
+    Simulation(int object_count, const std::vector<int> &mesh_mix, unsigned int seed);
 
-    struct Object {
-        Meshes::Type mesh{};
-        glm::vec3 light_pos{};
-        glm::vec3 light_color{};
+    [[nodiscard]] int object_count() const { return static_cast<int>(meshes_.size()); }
 
-        Animation animation;
-        Path path;
+    [[nodiscard]] const std::vector<Meshes::Type> &meshes() const { return meshes_; }
+    [[nodiscard]] const std::vector<glm::vec3> &light_positions() const { return light_positions_; }
+    [[nodiscard]] const std::vector<glm::vec3> &light_colors() const { return light_colors_; }
+    [[nodiscard]] const std::vector<uint32_t> &frame_data_offsets() const { return frame_data_offsets_; }
+    [[nodiscard]] const std::vector<glm::mat4> &models() const { return models_; }
+    [[nodiscard]] const std::vector<Pose> &poses() const { return poses_; }
 
-        uint32_t frame_data_offset{};
+    // name of the update and interpolation kernels picked for this CPU
+    [[nodiscard]] const char *kernel_name() const { return kernel_name_; }
 
-        glm::mat4 model{};
+    void set_frame_data_size(uint32_t size);
+    // what interpolate() fills, models() by default
+    enum TransformOutput {
+        OUTPUT_MODELS,
+        OUTPUT_POSES,
     };
+    void set_transform_output(TransformOutput output);
+    // radius of each mesh's bounding sphere before scaling
+    void set_mesh_radii(const std::array<float, Meshes::MESH_COUNT> &radii);
+    // advances the objects by time seconds, which may span many ticks
+    void update(float time, int begin, int end);
+    void swap_buffers();
 
-    [[nodiscard]] const std::vector<Object> &objects() const { return objects_; }
-//    unsigned int rng_seed() { return random_dev_(); }
+    // fills models() or poses() and the cull centers between the previous and the
+    // current tick, alpha being the fraction of a tick since the current one
+    void interpolate(float alpha, int begin, int end);
 
-    void set_frame_data_size(uint32_t size);
-    void update(float time, int begin, int end);
+    // tests the objects' bounding spheres, as placed by the last
+    // interpolate(), against the frustum planes
+    int cull(const std::array<glm::vec4, 6> &planes, int begin, int end, uint8_t *visible) const;
+
+    // hash of the per-object state, for comparing runs
+    [[nodiscard]] uint64_t state_hash() const;
 
    private:
-    std::random_device random_dev_{};
-    std::vector<Object> objects_{};
+    void init_objects(int begin, int end, const std::vector<Meshes::Type> &mesh_pattern);
+    // points streams_ at the published slots
+    void bind_streams();
+    [[nodiscard]] int slot(int offset) const { return (front_ + offset) % 3; }
+
+    // every per-object stream is derived from it
+    const uint64_t seed_;
+
+    // static per-object data
+    std::vector<Meshes::Type> meshes_{};
+    std::vector<glm::vec3> light_positions_{};
+    std::vector<glm::vec3> light_colors_{};
+    std::vector<uint32_t> frame_data_offsets_{};
+    std::vector<float> radii_{};
+    std::vector<float> scales_{};
+
+    // per-tick state, one slot per tick, see TransformStreams
+    std::vector<float> positions_[3][3]{};
+    std::vector<float> orientations_[3][4]{};
+    int front_{0};
+    bool published_{};
+
+    std::vector<float> axes_[3]{};
+    std::vector<float> speeds_{};
+    // seconds simulated; orientations are a closed-form function of it
+    std::vector<double> times_{};
+    std::vector<Path> paths_{};
+
+    // per-frame state
+    std::vector<float> centers_[3]{};
+    std::vector<glm::mat4> models_{};
+    std::vector<Pose> poses_{};
+
+    TransformStreams streams_{};
+    InterpolateTransformsFunc interpolate_transforms_{};
+    CullSpheresFunc cull_spheres_{};
+    UpdateOrientationsFunc update_orientations_{};
+    const char *kernel_name_{};
+
+    // only touched when a path starts a new subpath
+    std::vector<CounterRng> path_rngs_{};
 };
 
 #endif  // SIMULATION_H
@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2016 Google, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIMULATION_KERNELS_H
+#define SIMULATION_KERNELS_H
+
+#include <cmath>
+
+#include "Simulation.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMULATION_SSE2
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SIMULATION_NEON
+#endif
+
+void interpolate_transforms_avx2(const TransformStreams &streams, float alpha, int begin, int end);
+int cull_spheres_avx2(const CullStreams &streams, int begin, int end, uint8_t *visible);
+void update_orientations_avx2(const OrientationStreams &streams, float time, int begin, int end);
+
+namespace {
+
+struct ScalarLanes {
+    using V = float;
+    static constexpr int width = 1;
+
+    static V load(const float *p) { return *p; }
+    static void store(float *p, V v) { *p = v; }
+    static V set1(float f) { return f; }
+    static V add(V a, V b) { return a + b; }
+    static V sub(V a, V b) { return a - b; }
+    static V mul(V a, V b) { return a * b; }
+    static V min(V a, V b) { return a < b ? a : b; }
+    static V rsqrt(V a) { return 1.0f / std::sqrt(a); }
+};
+
+#ifdef SIMULATION_SSE2
+struct SseLanes {
+    using V = __m128;
+    static constexpr int width = 4;
+
+    static V load(const float *p) { return _mm_loadu_ps(p); }
+    static void store(float *p, V v) { _mm_storeu_ps(p, v); }
+    static V set1(float f) { return _mm_set1_ps(f); }
+    static V add(V a, V b) { return _mm_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+    static V min(V a, V b) { return _mm_min_ps(a, b); }
+    // estimate refined with one Newton-Raphson step
+    static V rsqrt(V a) {
+        const V r = _mm_rsqrt_ps(a);
+        return mul(r, sub(set1(1.5f), mul(mul(set1(0.5f), a), mul(r, r))));
+    }
+};
+#endif
+
+#if defined(__AVX2__)
+struct Avx2Lanes {
+    using V = __m256;
+    static constexpr int width = 8;
+
+    static V load(const float *p) { return _mm256_loadu_ps(p); }
+    static void store(float *p, V v) { _mm256_storeu_ps(p, v); }
+    static V set1(float f) { return _mm256_set1_ps(f); }
+    static V add(V a, V b) { return _mm256_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    static V min(V a, V b) { return _mm256_min_ps(a, b); }
+    static V rsqrt(V a) {
+        const V r = _mm256_rsqrt_ps(a);
+        return mul(r, sub(set1(1.5f), mul(mul(set1(0.5f), a), mul(r, r))));
+    }
+};
+#endif
+
+#ifdef SIMULATION_NEON
+struct NeonLanes {
+    using V = float32x4_t;
+    static constexpr int width = 4;
+
+    static V load(const float *p) { return vld1q_f32(p); }
+    static void store(float *p, V v) { vst1q_f32(p, v); }
+    static V set1(float f) { return vdupq_n_f32(f); }
+    static V add(V a, V b) { return vaddq_f32(a, b); }
+    static V sub(V a, V b) { return vsubq_f32(a, b); }
+    static V mul(V a, V b) { return vmulq_f32(a, b); }
+    static V min(V a, V b) { return vminq_f32(a, b); }
+    static V rsqrt(V a) {
+        const V r = vrsqrteq_f32(a);
+        return vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(a, r), r));
+    }
+};
+#endif
+
+// Double lanes for the simulation, which must give the same bits on every
+// CPU.  They only use operations that IEEE 754 rounds exactly, and round()
+// rounds half to even like the default rounding mode.
+struct ScalarDoubleLanes {
+    using V = double;
+    static constexpr int width = 1;
+
+    static V load(const double *p) { return *p; }
+    static V load(const float *p) { return *p; }
+    static void store(double *p, V v) { *p = v; }
+    static V set1(double d) { return d; }
+    static V add(V a, V b) { return a + b; }
+    static V sub(V a, V b) { return a - b; }
+    static V mul(V a, V b) { return a * b; }
+    static V round(V a) { return std::nearbyint(a); }
+};
+
+#ifdef SIMULATION_SSE2
+struct SseDoubleLanes {
+    using V = __m128d;
+    static constexpr int width = 2;
+
+    static V load(const double *p) { return _mm_loadu_pd(p); }
+    static V load(const float *p) { return _mm_cvtps_pd(_mm_setr_ps(p[0], p[1], 0.0f, 0.0f)); }
+    static void store(double *p, V v) { _mm_storeu_pd(p, v); }
+    static V set1(double d) { return _mm_set1_pd(d); }
+    static V add(V a, V b) { return _mm_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+    // through int32, which holds any quadrant count the simulation reaches
+    static V round(V a) { return _mm_cvtepi32_pd(_mm_cvtpd_epi32(a)); }
+};
+#endif
+
+#if defined(__AVX2__)
+struct Avx2DoubleLanes {
+    using V = __m256d;
+    static constexpr int width = 4;
+
+    static V load(const double *p) { return _mm256_loadu_pd(p); }
+    static V load(const float *p) { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+    static void store(double *p, V v) { _mm256_storeu_pd(p, v); }
+    static V set1(double d) { return _mm256_set1_pd(d); }
+    static V add(V a, V b) { return _mm256_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+    static V round(V a) { return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+};
+#endif
+
+#if defined(SIMULATION_NEON) && defined(__aarch64__)
+#define SIMULATION_NEON_DOUBLE
+struct NeonDoubleLanes {
+    using V = float64x2_t;
+    static constexpr int width = 2;
+
+    static V load(const double *p) { return vld1q_f64(p); }
+    static V load(const float *p) { return vcvt_f64_f32(vld1_f32(p)); }
+    static void store(double *p, V v) { vst1q_f64(p, v); }
+    static V set1(double d) { return vdupq_n_f64(d); }
+    static V add(V a, V b) { return vaddq_f64(a, b); }
+    static V sub(V a, V b) { return vsubq_f64(a, b); }
+    static V mul(V a, V b) { return vmulq_f64(a, b); }
+    static V round(V a) { return vrndnq_f64(a); }
+};
+#endif
+
+// sin and cos of L::width angles from basic arithmetic only, so that the
+// results do not depend on the C library or on the lane width
+template <typename L>
+void sincos_lanes(typename L::V x, double *s, double *c) {
+    using V = typename L::V;
+
+    // reduce by pi/2 in two parts, so that q * pi_over_2_hi is exact
+    const V q = L::round(L::mul(x, L::set1(0.63661977236758134308)));
+    const V r = L::sub(L::sub(x, L::mul(q, L::set1(1.57079632673412561417))),
+                       L::mul(q, L::set1(6.07710050650619224932e-11)));
+    const V r2 = L::mul(r, r);
+
+    // Taylor series, accurate to ~1e-11 on [-pi/4, pi/4]
+    V sr = L::set1(-1.0 / 39916800.0);
+    for (double k : {1.0 / 362880.0, -1.0 / 5040.0, 1.0 / 120.0, -1.0 / 6.0, 1.0})
+        sr = L::add(L::set1(k), L::mul(r2, sr));
+    sr = L::mul(r, sr);
+
+    V cr = L::set1(1.0 / 479001600.0);
+    for (double k : {-1.0 / 3628800.0, 1.0 / 40320.0, -1.0 / 720.0, 1.0 / 24.0, -1.0 / 2.0, 1.0})
+        cr = L::add(L::set1(k), L::mul(r2, cr));
+
+    // pick and negate by quadrant, one lane at a time and without branches,
+    // as the quadrants are random
+    double lanes[3][L::width];
+    L::store(lanes[0], q);
+    L::store(lanes[1], sr);
+    L::store(lanes[2], cr);
+    for (int lane = 0; lane < L::width; lane++) {
+        const auto quadrant = static_cast<int64_t>(lanes[0][lane]);
+        const double sign = (quadrant & 2) ? -1.0 : 1.0;
+        const bool odd = (quadrant & 1) != 0;
+        s[lane] = (odd ? lanes[2][lane] : lanes[1][lane]) * sign;
+        c[lane] = (odd ? -lanes[1][lane] : lanes[2][lane]) * sign;
+    }
+}
+
+// Advances the clocks of L::width objects by time and writes their
+// orientations, a rotation about a fixed axis at a fixed speed.  The angle
+// is a closed-form function of the clock, so it can jump by many ticks and no
+// error accumulates from tick to tick.  Unlike interpolation the results feed
+// the next tick, so every lane width must round the same way.
+template <typename L>
+void update_orientations_lanes(const OrientationStreams &s, float time, int i) {
+    using V = typename L::V;
+
+    const V t = L::add(L::load(s.time + i), L::set1(time));
+    L::store(s.time + i, t);
+
+    // the clock is kept in double, so that late angles keep their precision
+    const V half_angle = L::mul(L::mul(L::set1(0.5), L::load(s.speed + i)), t);
+
+    double sines[L::width];
+    double cosines[L::width];
+    sincos_lanes<L>(half_angle, sines, cosines);
+
+    for (int lane = 0; lane < L::width; lane++) {
+        const float sine = static_cast<float>(sines[lane]);
+        for (int k = 0; k < 3; k++) s.orientation[k][i + lane] = s.axis[k][i + lane] * sine;
+        s.orientation[3][i + lane] = static_cast<float>(cosines[lane]);
+    }
+}
+
+template <typename L>
+void update_orientations(const OrientationStreams &streams, float time, int begin, int end) {
+    int i = begin;
+    for (; i + L::width <= end; i += L::width) update_orientations_lanes<L>(streams, time, i);
+    for (; i < end; i++) update_orientations_lanes<ScalarDoubleLanes>(streams, time, i);
+}
+
+// Blends the previous and the current tick of L::width objects by alpha and
+// writes the centers and translate(position) * rotation * scale out, as a
+// matrix, a pose or both.  The
+// orientations are blended with a normalized lerp, which needs no sign fix as
+// an object turns far less than half a revolution per tick.  The results are
+// only drawn, so the lanes may round differently from the scalar code.
+template <typename L>
+void interpolate_transforms_lanes(const TransformStreams &s, float alpha, int i) {
+    using V = typename L::V;
+
+    const V a = L::set1(alpha);
+
+    V pos[3];
+    for (int k = 0; k < 3; k++) {
+        const V p0 = L::load(s.position[0][k] + i);
+        const V p1 = L::load(s.position[1][k] + i);
+        pos[k] = L::add(p0, L::mul(L::sub(p1, p0), a));
+        L::store(s.center[k] + i, pos[k]);
+    }
+
+    V q[4];
+    for (int k = 0; k < 4; k++) {
+        const V q0 = L::load(s.orientation[0][k] + i);
+        const V q1 = L::load(s.orientation[1][k] + i);
+        q[k] = L::add(q0, L::mul(L::sub(q1, q0), a));
+    }
+
+    V norm = L::mul(q[0], q[0]);
+    for (int k = 1; k < 4; k++) norm = L::add(norm, L::mul(q[k], q[k]));
+    const V inv_len = L::rsqrt(norm);
+    const V scale = L::load(s.scale + i);
+
+    if (s.poses) {
+        float lanes[8][L::width];
+        for (int k = 0; k < 3; k++) L::store(lanes[k], pos[k]);
+        L::store(lanes[3], scale);
+        for (int k = 0; k < 4; k++) L::store(lanes[4 + k], L::mul(q[k], inv_len));
+
+        for (int lane = 0; lane < L::width; lane++) {
+            float *p = s.poses + 8 * (i + lane);
+            for (int k = 0; k < 8; k++) p[k] = lanes[k][lane];
+        }
+    }
+
+    if (!s.models) return;
+
+    // fold the normalization and the scale into the factor of two of the
+    // quaternion to matrix conversion
+    const V two = L::mul(L::set1(2.0f), L::mul(scale, L::mul(inv_len, inv_len)));
+
+    const V x2 = L::mul(q[0], two);
+    const V y2 = L::mul(q[1], two);
+    const V z2 = L::mul(q[2], two);
+    const V xx = L::mul(q[0], x2);
+    const V yy = L::mul(q[1], y2);
+    const V zz = L::mul(q[2], z2);
+    const V xy = L::mul(q[0], y2);
+    const V xz = L::mul(q[0], z2);
+    const V yz = L::mul(q[1], z2);
+    const V wx = L::mul(q[3], x2);
+    const V wy = L::mul(q[3], y2);
+    const V wz = L::mul(q[3], z2);
+
+    V out[12];
+    out[0] = L::sub(scale, L::add(yy, zz));
+    out[1] = L::add(xy, wz);
+    out[2] = L::sub(xz, wy);
+    out[3] = L::sub(xy, wz);
+    out[4] = L::sub(scale, L::add(xx, zz));
+    out[5] = L::add(yz, wx);
+    out[6] = L::add(xz, wy);
+    out[7] = L::sub(yz, wx);
+    out[8] = L::sub(scale, L::add(xx, yy));
+    for (int k = 0; k < 3; k++) out[9 + k] = pos[k];
+
+    // scatter to the column-major matrices
+    float lanes[12][L::width];
+    for (int k = 0; k < 12; k++) L::store(lanes[k], out[k]);
+
+    for (int lane = 0; lane < L::width; lane++) {
+        float *m = s.models + 16 * (i + lane);
+        for (int col = 0; col < 4; col++) {
+            m[col * 4 + 0] = lanes[col * 3 + 0][lane];
+            m[col * 4 + 1] = lanes[col * 3 + 1][lane];
+            m[col * 4 + 2] = lanes[col * 3 + 2][lane];
+            m[col * 4 + 3] = (col == 3) ? 1.0f : 0.0f;
+        }
+    }
+}
+
+template <typename L>
+void interpolate_transforms(const TransformStreams &streams, float alpha, int begin, int end) {
+    int i = begin;
+    for (; i + L::width <= end; i += L::width) interpolate_transforms_lanes<L>(streams, alpha, i);
+    for (; i < end; i++) interpolate_transforms_lanes<ScalarLanes>(streams, alpha, i);
+}
+
+// Tests L::width spheres against every plane.  A sphere is visible unless it
+// is entirely behind one of the planes.
+template <typename L>
+int cull_spheres_lanes(const CullStreams &s, int i, uint8_t *visible) {
+    using V = typename L::V;
+
+    const V x = L::load(s.center[0] + i);
+    const V y = L::load(s.center[1] + i);
+    const V z = L::load(s.center[2] + i);
+    const V r = L::load(s.radius + i);
+
+    // smallest signed distance of the sphere to any plane
+    V dist{};
+    for (int p = 0; p < 6; p++) {
+        V d = L::mul(x, L::set1(s.planes[p][0]));
+        d = L::add(d, L::mul(y, L::set1(s.planes[p][1])));
+        d = L::add(d, L::mul(z, L::set1(s.planes[p][2])));
+        d = L::add(d, L::add(L::set1(s.planes[p][3]), r));
+        dist = p ? L::min(dist, d) : d;
+    }
+
+    float lanes[L::width];
+    L::store(lanes, dist);
+
+    int count = 0;
+    for (int lane = 0; lane < L::width; lane++) {
+        visible[lane] = lanes[lane] >= 0.0f;
+        count += visible[lane];
+    }
+
+    return count;
+}
+
+template <typename L>
+int cull_spheres(const CullStreams &streams, int begin, int end, uint8_t *visible) {
+    int count = 0;
+    int i = begin;
+    for (; i + L::width <= end; i += L::width) count += cull_spheres_lanes<L>(streams, i, visible + (i - begin));
+    for (; i < end; i++) count += cull_spheres_lanes<ScalarLanes>(streams, i, visible + (i - begin));
+    return count;
+}
+
+}  // namespace
+
+#endif  // SIMULATION_KERNELS_H
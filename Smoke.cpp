@@ -14,8 +14,20 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <array>
-
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#endif
+
+#include <glm/gtc/packing.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -23,25 +35,165 @@
 #include "Smoke.h"
 #include "Meshes.h"
 #include "Shell.h"
+#include "Trace.h"
 
 namespace {
-    // TODO move lower frequency data to another descriptor set
     // FIX: Ensure compiler uses std140 layout by adding a 16-byte alignment attribute
     // Add a 16-byte (128-bit) alignment attribute
+    // everything a draw needs, pushed per object for DRAW_PUSH_CONSTANTS
     struct alignas(16) ShaderParamBlock {
         float light_pos[4];           // vec4/float[4] = 16 bytes (already aligned to 16)
         float light_color[4];         // vec4/float[4] = 16 bytes (already aligned to 16)
         float model[4 * 4];           // mat4 = 16 bytes per column (already aligned to 16)
         float view_projection[4 * 4]; // mat4 = 16 bytes per column (already aligned to 16)
     };
+
+    // The other modes split the parameters by how often they change: the
+    // camera once per frame, the model matrix per object per frame, and the
+    // lights never.
+    struct CameraBlock {
+        float view_projection[4 * 4];
+    };
+
+    // the transform encodings, see TransformEncoding and decode_transform in
+    // the shaders
+    struct ObjectTransform {
+        float model[4 * 4];
+    };
+
+    struct AffineTransform {
+        float rows[3][4];
+    };
+
+    struct QuatTransform {
+        float position[3];
+        float scale;
+        float orientation[4];
+    };
+
+    struct HalfQuatTransform {
+        // position.xy, position.z and scale, orientation.xy, orientation.zw
+        uint32_t halves[4];
+    };
+
+    VkDeviceSize transform_size(int encoding) {
+        constexpr std::array<VkDeviceSize, 4> sizes = {sizeof(ObjectTransform), sizeof(AffineTransform),
+                                                       sizeof(QuatTransform), sizeof(HalfQuatTransform)};
+        return sizes[encoding];
+    }
+
+    const char *transform_name(int encoding) {
+        constexpr std::array<const char *, 4> names = {"mat4", "affine", "quat", "quat-half"};
+        return names[encoding];
+    }
+
+    struct alignas(16) ObjectParams {
+        float light_pos[4];
+        float light_color[4];
+    };
+
+    struct CullPushConstants {
+        float frustum_planes[6][4];
+        uint32_t object_count;
+    };
+
+    // how long to poll before sleeping on a worker handoff
+    constexpr int spin_count = 4096;
+
+    // objects per chunk of work; small enough to balance the teapot-heavy
+    // stretches of the mesh pattern, large enough to amortize a command buffer
+    constexpr int chunk_size = 256;
+
+    void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+        _mm_pause();
+#elif defined(__aarch64__) && !defined(_MSC_VER)
+        asm volatile("yield");
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    // returns the first value of an atomic that differs from old
+    uint64_t wait_for_change(const std::atomic<uint64_t> &value, uint64_t old) {
+        for (int spin = 0; spin < spin_count; spin++) {
+            const uint64_t current = value.load(std::memory_order_acquire);
+            if (current != old) return current;
+            cpu_relax();
+        }
+
+        value.wait(old, std::memory_order_acquire);
+        return value.load(std::memory_order_acquire);
+    }
+
+    // Precedes the driver's data in a pipeline cache file.  The driver
+    // validates its own header too, but a cache from another driver version,
+    // or a truncated file, is better skipped than handed to it.
+    struct PipelineCacheFileHeader {
+        char magic[8];
+        uint32_t vendor_id;
+        uint32_t device_id;
+        uint32_t driver_version;
+        uint8_t uuid[VK_UUID_SIZE];
+        uint64_t data_size;
+        uint64_t data_hash;
+    };
+
+    constexpr char pipeline_cache_magic[8] = {'S', 'M', 'K', 'P', 'C', 'A', 'C', 'H'};
+
+    // FNV-1a
+    uint64_t hash_bytes(const uint8_t *data, size_t size) {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < size; i++) hash = (hash ^ data[i]) * 0x100000001b3ull;
+        return hash;
+    }
+
+    PipelineCacheFileHeader make_pipeline_cache_header(const VkPhysicalDeviceProperties &props) {
+        PipelineCacheFileHeader header = {};
+        memcpy(header.magic, pipeline_cache_magic, sizeof(header.magic));
+        header.vendor_id = props.vendorID;
+        header.device_id = props.deviceID;
+        header.driver_version = props.driverVersion;
+        memcpy(header.uuid, props.pipelineCacheUUID, sizeof(header.uuid));
+        return header;
+    }
+
+    // returns why the data cannot be used, or nullptr
+    const char *validate_pipeline_cache(const PipelineCacheFileHeader &expected, const PipelineCacheFileHeader &header,
+                                        const std::vector<uint8_t> &data) {
+        if (memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0) return "not a pipeline cache";
+        if (header.vendor_id != expected.vendor_id || header.device_id != expected.device_id)
+            return "made for another device";
+        if (header.driver_version != expected.driver_version) return "made by another driver version";
+        if (memcmp(header.uuid, expected.uuid, sizeof(header.uuid)) != 0) return "made for another cache UUID";
+        if (header.data_size != data.size()) return "truncated";
+        if (header.data_hash != hash_bytes(data.data(), data.size())) return "corrupted";
+
+        // VkPipelineCacheHeaderVersionOne
+        struct {
+            uint32_t header_size;
+            uint32_t header_version;
+            uint32_t vendor_id;
+            uint32_t device_id;
+            uint8_t uuid[VK_UUID_SIZE];
+        } vk_header{};
+        if (data.size() < sizeof(vk_header)) return "truncated";
+        memcpy(&vk_header, data.data(), sizeof(vk_header));
+        if (vk_header.header_size < sizeof(vk_header) || vk_header.header_version != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+            vk_header.vendor_id != expected.vendor_id || vk_header.device_id != expected.device_id ||
+            memcmp(vk_header.uuid, expected.uuid, sizeof(vk_header.uuid)) != 0)
+            return "rejected by its own header";
+
+        return nullptr;
+    }
 }  // namespace
 
 Smoke::Smoke(const std::vector<std::string> &args)
         : Game("Smoke", args),
           multithread_(true),
-          use_push_constants_(false),
+          draw_mode_(DRAW_FIRST_INSTANCE),
           sim_paused_(false),
-          sim_(5000),
+          sim_(settings_.object_count, settings_.mesh_mix, settings_.seed),
           camera_(2.5f),
           frame_data_(),
           render_pass_clear_value_({{{0.0f, 0.1f, 0.2f, 1.0f}}}),
@@ -52,37 +204,72 @@ Smoke::Smoke(const std::vector<std::string> &args)
         if (arg == "-s")
             multithread_ = false;
         else if (arg == "-p")
-            use_push_constants_ = true;
+            draw_mode_ = DRAW_PUSH_CONSTANTS;
+        else if (arg == "--dynamic-offsets")
+            draw_mode_ = DRAW_DYNAMIC_OFFSET;
+        else if (arg == "--instanced")
+            draw_mode_ = DRAW_INSTANCED;
+        else if (arg == "--indirect")
+            draw_mode_ = DRAW_INDIRECT;
+        else if (arg == "--cpu-cull")
+            cpu_cull_ = true;
+        else if (arg == "--pipelined")
+            pipelined_ = true;
+        else if (arg == "--affine-transforms")
+            transform_encoding_ = TRANSFORM_AFFINE;
+        else if (arg == "--quat-transforms")
+            transform_encoding_ = TRANSFORM_QUAT;
+        else if (arg == "--half-transforms")
+            transform_encoding_ = TRANSFORM_QUAT_HALF;
+        else if (arg == "--gpu-cull") {
+            draw_mode_ = DRAW_INDIRECT;
+            gpu_cull_ = true;
+        }
     }
 
     init_workers();
+
+    // jump straight to a later state, e.g. to skip the warm-up of a benchmark
+    if (settings_.warm_start > 0.0f) {
+        sim_.update(settings_.warm_start, 0, sim_.object_count());
+        sim_.swap_buffers();
+    }
 }
 
 Smoke::~Smoke() = default;
 
 void Smoke::init_workers() {
+    const int chunk_count = (sim_.object_count() + chunk_size - 1) / chunk_size;
+
+    chunks_.reserve(chunk_count);
+    for (int i = 0; i < chunk_count; i++) {
+        Chunk chunk = {};
+        chunk.index = i;
+        chunk.object_begin = i * chunk_size;
+        chunk.object_end = std::min(chunk.object_begin + chunk_size, sim_.object_count());
+        for (int obj = chunk.object_begin; obj < chunk.object_end; obj++) chunk.mesh_counts[sim_.meshes()[obj]]++;
+
+        chunks_.push_back(chunk);
+    }
+
     int worker_count = (int) std::thread::hardware_concurrency();
 
+    // no point in idle workers
+    if (worker_count > chunk_count) worker_count = chunk_count;
+
     // not enough cores
     if (!multithread_ || worker_count < 2) {
         multithread_ = false;
         worker_count = 1;
     }
 
-    const int object_per_worker = static_cast<int>(sim_.objects().size()) / worker_count;
-    int object_begin = 0, object_end = 0;
-
     workers_.reserve(worker_count);
     for (int i = 0; i < worker_count; i++) {
-        object_begin = object_end;
-        if (i < worker_count - 1)
-            object_end += object_per_worker;
-        else
-            object_end = static_cast<int>(sim_.objects().size());
-
-        worker = new Worker(*this, i, object_begin, object_end);
+        worker = new Worker(*this, i);
         workers_.emplace_back(std::unique_ptr<Worker>(worker));
     }
+
+    if (cpu_cull_) cull_visible_.resize(sim_.object_count());
 }
 
 void Smoke::attach_shell(Shell &sh) {
@@ -97,26 +284,144 @@ void Smoke::attach_shell(Shell &sh) {
 
     vk::GetPhysicalDeviceProperties(physical_dev_, &physical_dev_props_);
 
-    if (use_push_constants_ && sizeof(ShaderParamBlock) > physical_dev_props_.limits.maxPushConstantsSize) {
+    if (draw_mode_ == DRAW_PUSH_CONSTANTS && sizeof(ShaderParamBlock) > physical_dev_props_.limits.maxPushConstantsSize) {
         shell_->log(Shell::LOG_WARN, "cannot enable push constants");
-        use_push_constants_ = false;
+        draw_mode_ = DRAW_FIRST_INSTANCE;
+    }
+
+    // the per-object draw commands select the parameter block with firstInstance
+    if (draw_mode_ == DRAW_INDIRECT && !ctx.features.drawIndirectFirstInstance) {
+        shell_->log(Shell::LOG_WARN, "cannot enable indirect draws");
+        draw_mode_ = DRAW_INSTANCED;
+    }
+    multi_draw_indirect_ = ctx.features.multiDrawIndirect;
+    draw_indirect_count_ = multi_draw_indirect_ && ctx.draw_indirect_count;
+
+    // all but dynamic offset draws see every object of the frame through one descriptor
+    const VkDeviceSize packed_object_size = std::max(transform_size(transform_encoding_), sizeof(ObjectParams));
+    if ((draw_mode_ == DRAW_FIRST_INSTANCE || draw_mode_ == DRAW_INSTANCED || draw_mode_ == DRAW_INDIRECT) &&
+        packed_object_size * sim_.object_count() > physical_dev_props_.limits.maxStorageBufferRange) {
+        const char *draws = (draw_mode_ == DRAW_FIRST_INSTANCE) ? ""
+                            : (draw_mode_ == DRAW_INSTANCED)    ? " for instanced draws"
+                                                                : " for indirect draws";
+        shell_->log(Shell::LOG_WARN,
+                    (std::string("cannot pack object data") + draws + ", using dynamic offsets").c_str());
+        draw_mode_ = DRAW_DYNAMIC_OFFSET;
+    }
+
+    // the compacted draws are consumed with a GPU-side draw count
+    if (gpu_cull_ && (draw_mode_ != DRAW_INDIRECT || !draw_indirect_count_)) {
+        shell_->log(Shell::LOG_WARN, "cannot enable GPU culling");
+        gpu_cull_ = false;
+    }
+    if (gpu_cull_ && cpu_cull_) {
+        shell_->log(Shell::LOG_WARN, "GPU culling replaces CPU culling");
+        cpu_cull_ = false;
+    }
+
+    // push constants carry the whole matrix
+    if (draw_mode_ == DRAW_PUSH_CONSTANTS && transform_encoding_ != TRANSFORM_MAT4) {
+        shell_->log(Shell::LOG_WARN, "cannot enable compact transforms");
+        transform_encoding_ = TRANSFORM_MAT4;
+    }
+    // the quaternion encodings are packed from poses rather than matrices
+    sim_.set_transform_output((transform_encoding_ == TRANSFORM_QUAT || transform_encoding_ == TRANSFORM_QUAT_HALF)
+                                      ? Simulation::OUTPUT_POSES
+                                      : Simulation::OUTPUT_MODELS);
+
+    // timestamps are written by the graphics queue, inside secondary command buffers
+    std::vector<VkQueueFamilyProperties> queue_props;
+    vk::get(physical_dev_, queue_props);
+    const uint32_t timestamp_bits = queue_props[queue_family_].timestampValidBits;
+    timestamps_ = physical_dev_props_.limits.timestampComputeAndGraphics && timestamp_bits;
+    if (timestamps_) {
+        timestamp_mask_ = (timestamp_bits >= 64) ? UINT64_MAX : (uint64_t(1) << timestamp_bits) - 1;
+        timestamp_period_ = physical_dev_props_.limits.timestampPeriod;
+        worker_gpu_time_.assign(workers_.size(), 0.0);
+    } else {
+        shell_->log(Shell::LOG_WARN, "cannot enable GPU timestamps");
     }
 
-    VkPhysicalDeviceMemoryProperties mem_props;
-    vk::GetPhysicalDeviceMemoryProperties(physical_dev_, &mem_props);
-    mem_flags_.reserve(mem_props.memoryTypeCount);
-    for (uint32_t i = 0; i < mem_props.memoryTypeCount; i++)
-        mem_flags_.push_back(mem_props.memoryTypes[i].propertyFlags);
+    std::stringstream ss;
+    ss << sim_.object_count() << " objects, seed " << settings_.seed << ", simulation kernel: " << sim_.kernel_name();
+    shell_->log(Shell::LOG_INFO, ss.str().c_str());
+
+    ss.str("");
+    ss << chunks_.size() << " chunks of " << chunk_size << " objects on " << workers_.size() << " workers"
+       << (pipelined_ ? ", simulation pipelined with recording" : "");
+    shell_->log(Shell::LOG_INFO, ss.str().c_str());
+
+    if (draw_mode_ == DRAW_INDIRECT) {
+        ss.str("");
+        ss << "indirect draws: multiDrawIndirect " << (multi_draw_indirect_ ? "on" : "off") << ", drawIndirectCount "
+           << (draw_indirect_count_ ? "on" : "off") << ", GPU culling " << (gpu_cull_ ? "on" : "off");
+        shell_->log(Shell::LOG_INFO, ss.str().c_str());
+    }
 
-    meshes_ = new Meshes(dev_, mem_flags_);
+    allocator_ = std::make_unique<Allocator>(physical_dev_, dev_);
+
+    meshes_ = new Meshes(dev_, *allocator_, {queue_, queue_family_, ctx.transfer_queue, ctx.transfer_queue_family});
+
+    const Meshes::UploadStats &upload = meshes_->upload_stats();
+    ss.str("");
+    ss << "meshes: " << upload.size / 1024 << " KiB ";
+    if (!upload.staged)
+        ss << "written in place";
+    else if (ctx.transfer_queue_family != queue_family_)
+        ss << "staged on the transfer queue";
+    else
+        ss << "staged on the graphics queue";
+    ss << std::fixed << std::setprecision(2) << " (build " << upload.build_ms << " ms, allocate " << upload.allocate_ms
+       << " ms, write " << upload.write_ms << " ms, transfer " << upload.transfer_ms << " ms)";
+    shell_->log(Shell::LOG_INFO, ss.str().c_str());
+
+    if (cpu_cull_) {
+        std::array<float, Meshes::MESH_COUNT> radii{};
+        for (int type = 0; type < Meshes::MESH_COUNT; type++)
+            radii[type] = meshes_->bounding_radius(static_cast<Meshes::Type>(type));
+        sim_.set_mesh_radii(radii);
+    }
 
     create_render_pass();
     create_shader_modules();
     create_descriptor_set_layout();
     create_pipeline_layout();
+
+    // startup is dominated by shader compilation on some drivers
+    create_pipeline_cache();
+    const auto pipeline_start = std::chrono::steady_clock::now();
     create_pipeline();
+    if (gpu_cull_) create_cull_pipeline();
+    const std::chrono::duration<double, std::milli> pipeline_time = std::chrono::steady_clock::now() - pipeline_start;
+
+    ss.str("");
+    ss << "pipelines created in " << std::fixed << std::setprecision(1) << pipeline_time.count() << " ms";
+    shell_->log(Shell::LOG_INFO, ss.str().c_str());
+
     create_frame_data();
 
+    if (draw_mode_ != DRAW_PUSH_CONSTANTS) {
+        // what the same objects take when each is padded to a dynamic offset
+        const VkDeviceSize alignment = physical_dev_props_.limits.minStorageBufferOffsetAlignment;
+        auto padded = [alignment](VkDeviceSize size) { return (size + alignment - 1) / alignment * alignment; };
+        const VkDeviceSize packed_size = transform_size(transform_encoding_) + sizeof(ObjectParams);
+        const VkDeviceSize padded_size = padded(transform_size(transform_encoding_)) + padded(sizeof(ObjectParams));
+
+        ss.str("");
+        ss << "object layout: " << packed_size << " bytes per object packed, " << padded_size
+           << " padded to minStorageBufferOffsetAlignment " << alignment << ", using "
+           << ((draw_mode_ == DRAW_DYNAMIC_OFFSET) ? "padded" : "packed");
+        shell_->log(Shell::LOG_INFO, ss.str().c_str());
+
+        ss.str("");
+        ss << "object data: " << transform_name(transform_encoding_) << " transforms, " << frame_data_object_size_
+           << " bytes per object per frame, " << static_object_size_
+           << " bytes per object written once " << (static_staged_ ? "through a staging buffer" : "in place");
+        shell_->log(Shell::LOG_INFO, ss.str().c_str());
+    }
+
+    for (const auto &line: allocator_->stats()) shell_->log(Shell::LOG_INFO, line.c_str());
+
     render_pass_begin_info_.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     render_pass_begin_info_.renderPass = render_pass_;
     render_pass_begin_info_.clearValueCount = 1;
@@ -136,24 +441,35 @@ void Smoke::attach_shell(Shell &sh) {
 
     if (multithread_) {
         for (auto &work: workers_) work->start();
+        workers_running_ = true;
     }
 }
 
 void Smoke::detach_shell() {
-    if (multithread_) {
-        for (auto &work: workers_) work->stop();
-    }
+    if (multithread_) stop_workers();
 
     destroy_frame_data();
 
+    if (gpu_cull_) {
+        vk::DestroyPipeline(dev_, cull_pipeline_, nullptr);
+        vk::DestroyPipelineLayout(dev_, cull_pipeline_layout_, nullptr);
+        vk::DestroyDescriptorSetLayout(dev_, cull_desc_set_layout_, nullptr);
+        vk::DestroyShaderModule(dev_, cull_cs_, nullptr);
+    }
+
     vk::DestroyPipeline(dev_, pipeline_, nullptr);
+    destroy_pipeline_cache();
     vk::DestroyPipelineLayout(dev_, pipeline_layout_, nullptr);
-    if (!use_push_constants_) vk::DestroyDescriptorSetLayout(dev_, desc_set_layout_, nullptr);
+    if (draw_mode_ != DRAW_PUSH_CONSTANTS) {
+        vk::DestroyDescriptorSetLayout(dev_, desc_set_layout_, nullptr);
+        vk::DestroyDescriptorSetLayout(dev_, camera_desc_set_layout_, nullptr);
+    }
     vk::DestroyShaderModule(dev_, fs_, nullptr);
     vk::DestroyShaderModule(dev_, vs_, nullptr);
     vk::DestroyRenderPass(dev_, render_pass_, nullptr);
 
     delete meshes_;
+    allocator_.reset();
 
     Game::detach_shell();
 }
@@ -165,7 +481,8 @@ void Smoke::create_render_pass() {
     attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // PRESENT_SRC_KHR for a swapchain, or what the shell reads offscreen images in
+    attachment.finalLayout = shell_->context().image_layout;
 
     VkAttachmentReference attachment_ref = {};
     attachment_ref.attachment = 0;
@@ -208,10 +525,18 @@ void Smoke::create_render_pass() {
 void Smoke::create_shader_modules() {
     VkShaderModuleCreateInfo sh_info = {};
     sh_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    if (use_push_constants_) {
+    if (draw_mode_ == DRAW_PUSH_CONSTANTS) {
 #include "Smoke.push_constant.vert.h"
         sh_info.codeSize = sizeof(Smoke_push_constant_vert);
         sh_info.pCode = Smoke_push_constant_vert;
+    } else if (draw_mode_ == DRAW_INSTANCED) {
+#include "Smoke.instanced.vert.h"
+        sh_info.codeSize = sizeof(Smoke_instanced_vert);
+        sh_info.pCode = Smoke_instanced_vert;
+    } else if (draw_mode_ == DRAW_FIRST_INSTANCE || draw_mode_ == DRAW_INDIRECT) {
+#include "Smoke.indirect.vert.h"
+        sh_info.codeSize = sizeof(Smoke_indirect_vert);
+        sh_info.pCode = Smoke_indirect_vert;
     } else {
 #include "Smoke.vert.h"
         sh_info.codeSize = sizeof(Smoke_vert);
@@ -226,29 +551,45 @@ void Smoke::create_shader_modules() {
 }
 
 void Smoke::create_descriptor_set_layout() {
-    if (use_push_constants_) return;
+    if (draw_mode_ == DRAW_PUSH_CONSTANTS) return;
 
-    VkDescriptorSetLayoutBinding layout_binding = {};
-    layout_binding.binding = 0;
-    layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
-    layout_binding.descriptorCount = 1;
-    layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    VkDescriptorSetLayoutBinding camera_binding = {};
+    camera_binding.binding = 0;
+    camera_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    camera_binding.descriptorCount = 1;
+    camera_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
     VkDescriptorSetLayoutCreateInfo layout_info = {};
     layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     layout_info.bindingCount = 1;
-    layout_info.pBindings = &layout_binding;
+    layout_info.pBindings = &camera_binding;
+
+    vk::assert_success(vk::CreateDescriptorSetLayout(dev_, &layout_info, nullptr, &camera_desc_set_layout_));
+
+    // the transforms, the static object parameters and, for DRAW_INSTANCED,
+    // the object of each instance
+    std::array<VkDescriptorSetLayoutBinding, 3> layout_bindings = {};
+    for (uint32_t i = 0; i < layout_bindings.size(); i++) {
+        layout_bindings[i].binding = i;
+        layout_bindings[i].descriptorType = (i < 2) ? frame_data_descriptor_type() : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layout_bindings[i].descriptorCount = 1;
+        layout_bindings[i].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    }
+
+    layout_info.bindingCount = (draw_mode_ == DRAW_INSTANCED) ? 3 : 2;
+    layout_info.pBindings = layout_bindings.data();
 
     vk::assert_success(vk::CreateDescriptorSetLayout(dev_, &layout_info, nullptr, &desc_set_layout_));
 }
 
 void Smoke::create_pipeline_layout() {
     VkPushConstantRange push_const_range = {};
+    const std::array<VkDescriptorSetLayout, 2> set_layouts = {camera_desc_set_layout_, desc_set_layout_};
 
     VkPipelineLayoutCreateInfo pipeline_layout_info = {};
     pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 
-    if (use_push_constants_) {
+    if (draw_mode_ == DRAW_PUSH_CONSTANTS) {
         push_const_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
         push_const_range.offset = 0;
         push_const_range.size = sizeof(ShaderParamBlock);
@@ -256,8 +597,8 @@ void Smoke::create_pipeline_layout() {
         pipeline_layout_info.pushConstantRangeCount = 1;
         pipeline_layout_info.pPushConstantRanges = &push_const_range;
     } else {
-        pipeline_layout_info.setLayoutCount = 1;
-        pipeline_layout_info.pSetLayouts = &desc_set_layout_;
+        pipeline_layout_info.setLayoutCount = static_cast<uint32_t>(set_layouts.size());
+        pipeline_layout_info.pSetLayouts = set_layouts.data();
     }
 
     vk::assert_success(vk::CreatePipelineLayout(dev_, &pipeline_layout_info, nullptr, &pipeline_layout_));
@@ -269,6 +610,16 @@ void Smoke::create_pipeline() {
     stage_info[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
     stage_info[0].module = vs_;
     stage_info[0].pName = "main";
+
+    // the transform encoding is constant_id 0 of the vertex and cull shaders
+    const auto encoding = static_cast<int32_t>(transform_encoding_);
+    const VkSpecializationMapEntry spec_entry = {0, 0, sizeof(encoding)};
+    VkSpecializationInfo spec_info = {};
+    spec_info.mapEntryCount = 1;
+    spec_info.pMapEntries = &spec_entry;
+    spec_info.dataSize = sizeof(encoding);
+    spec_info.pData = &encoding;
+    if (draw_mode_ != DRAW_PUSH_CONSTANTS) stage_info[0].pSpecializationInfo = &spec_info;
     stage_info[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     stage_info[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
     stage_info[1].module = fs_;
@@ -337,35 +688,185 @@ void Smoke::create_pipeline() {
     pipeline_info.layout = pipeline_layout_;
     pipeline_info.renderPass = render_pass_;
     pipeline_info.subpass = 0;
-    vk::assert_success(vk::CreateGraphicsPipelines(dev_, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline_));
+    vk::assert_success(vk::CreateGraphicsPipelines(dev_, pipeline_cache_, 1, &pipeline_info, nullptr, &pipeline_));
+}
+
+void Smoke::create_cull_pipeline() {
+    VkShaderModuleCreateInfo sh_info = {};
+    sh_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+#include "Smoke.cull.comp.h"
+    sh_info.codeSize = sizeof(Smoke_cull_comp);
+    sh_info.pCode = Smoke_cull_comp;
+    vk::assert_success(vk::CreateShaderModule(dev_, &sh_info, nullptr, &cull_cs_));
+
+    // transforms, draw sources, bounding radii, draw counts and visible draws
+    std::array<VkDescriptorSetLayoutBinding, 5> layout_bindings = {};
+    for (uint32_t i = 0; i < layout_bindings.size(); i++) {
+        layout_bindings[i].binding = i;
+        layout_bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layout_bindings[i].descriptorCount = 1;
+        layout_bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = static_cast<uint32_t>(layout_bindings.size());
+    layout_info.pBindings = layout_bindings.data();
+    vk::assert_success(vk::CreateDescriptorSetLayout(dev_, &layout_info, nullptr, &cull_desc_set_layout_));
+
+    VkPushConstantRange push_const_range = {};
+    push_const_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_const_range.offset = 0;
+    push_const_range.size = sizeof(CullPushConstants);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &cull_desc_set_layout_;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_const_range;
+    vk::assert_success(vk::CreatePipelineLayout(dev_, &pipeline_layout_info, nullptr, &cull_pipeline_layout_));
+
+    VkComputePipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = cull_cs_;
+    pipeline_info.stage.pName = "main";
+
+    const auto encoding = static_cast<int32_t>(transform_encoding_);
+    const VkSpecializationMapEntry spec_entry = {0, 0, sizeof(encoding)};
+    VkSpecializationInfo spec_info = {};
+    spec_info.mapEntryCount = 1;
+    spec_info.pMapEntries = &spec_entry;
+    spec_info.dataSize = sizeof(encoding);
+    spec_info.pData = &encoding;
+    pipeline_info.stage.pSpecializationInfo = &spec_info;
+    pipeline_info.layout = cull_pipeline_layout_;
+    vk::assert_success(vk::CreateComputePipelines(dev_, pipeline_cache_, 1, &pipeline_info, nullptr, &cull_pipeline_));
+}
+
+std::string Smoke::pipeline_cache_path() const {
+    std::stringstream ss;
+    ss << settings_.pipeline_cache_dir << "/smoke-pipeline-cache-" << std::hex << std::setfill('0') << std::setw(4)
+       << physical_dev_props_.vendorID << "-" << std::setw(4) << physical_dev_props_.deviceID << "-" << std::setw(8)
+       << physical_dev_props_.driverVersion << ".bin";
+    return ss.str();
+}
+
+void Smoke::create_pipeline_cache() {
+    std::vector<uint8_t> data;
+
+    if (!settings_.pipeline_cache_dir.empty()) {
+        const std::string path = pipeline_cache_path();
+        const PipelineCacheFileHeader expected = make_pipeline_cache_header(physical_dev_props_);
+
+        std::stringstream ss;
+        std::ifstream in(path, std::ios::binary);
+        PipelineCacheFileHeader header = {};
+        if (!in) {
+            ss << "pipeline cache: cold, no " << path;
+        } else if (!in.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+            ss << "pipeline cache: cold, " << path << " is truncated";
+        } else {
+            data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+
+            const char *error = validate_pipeline_cache(expected, header, data);
+            if (error) {
+                ss << "pipeline cache: cold, " << path << " is " << error;
+                data.clear();
+            } else {
+                ss << "pipeline cache: warm, " << data.size() << " bytes from " << path;
+            }
+        }
+        shell_->log(Shell::LOG_INFO, ss.str().c_str());
+    } else {
+        shell_->log(Shell::LOG_INFO, "pipeline cache: off");
+    }
+
+    VkPipelineCacheCreateInfo cache_info = {};
+    cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cache_info.initialDataSize = data.size();
+    cache_info.pInitialData = data.data();
+    vk::assert_success(vk::CreatePipelineCache(dev_, &cache_info, nullptr, &pipeline_cache_));
+}
+
+void Smoke::destroy_pipeline_cache() {
+    if (!settings_.pipeline_cache_dir.empty()) {
+        size_t size = 0;
+        vk::assert_success(vk::GetPipelineCacheData(dev_, pipeline_cache_, &size, nullptr));
+        std::vector<uint8_t> data(size);
+        const VkResult res = vk::GetPipelineCacheData(dev_, pipeline_cache_, &size, data.data());
+        data.resize(size);
+
+        PipelineCacheFileHeader header = make_pipeline_cache_header(physical_dev_props_);
+        header.data_size = data.size();
+        header.data_hash = hash_bytes(data.data(), data.size());
+
+        // write next to the cache and rename over it, so that a crash or a
+        // concurrent run never leaves a partial file behind
+        const std::string path = pipeline_cache_path();
+        const std::string tmp_path = path + ".tmp";
+        bool written = false;
+        if (res == VK_SUCCESS) {
+            std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+            out.close();
+            written = out.good() && std::rename(tmp_path.c_str(), path.c_str()) == 0;
+            // rename does not replace an existing file everywhere
+            if (out.good() && !written) {
+                std::remove(path.c_str());
+                written = std::rename(tmp_path.c_str(), path.c_str()) == 0;
+            }
+        }
+
+        if (!written) {
+            std::remove(tmp_path.c_str());
+            std::stringstream ss;
+            ss << "failed to save the pipeline cache to " << path;
+            shell_->log(Shell::LOG_WARN, ss.str().c_str());
+        }
+    }
+
+    vk::DestroyPipelineCache(dev_, pipeline_cache_, nullptr);
+    pipeline_cache_ = VK_NULL_HANDLE;
 }
 
 void Smoke::create_frame_data() {
-    frame_data_.resize(2); // If other parameters are needed, add an argument
+    frame_data_.resize(settings_.frames_in_flight);
 
     create_fences();
     create_command_buffers();
 
-    if (!use_push_constants_) {
+    if (draw_mode_ != DRAW_PUSH_CONSTANTS) {
         create_buffers();
         create_buffer_memory();
+        create_static_buffer();
         create_descriptor_sets();
     }
 
+    if (timestamps_) create_query_pools();
+
     frame_data_index_ = 0;
 }
 
 void Smoke::destroy_frame_data() {
-    if (!use_push_constants_) {
+    if (draw_mode_ != DRAW_PUSH_CONSTANTS) {
         vk::DestroyDescriptorPool(dev_, desc_pool_, nullptr);
-        vk::UnmapMemory(dev_, frame_data_mem_);
-        vk::FreeMemory(dev_, frame_data_mem_, nullptr);
+        for (auto &data: frame_data_) {
+            vk::DestroyBuffer(dev_, data.buf, nullptr);
+            allocator_->free(data.mem);
+        }
 
-        for (auto &data: frame_data_) vk::DestroyBuffer(dev_, data.buf, nullptr);
+        vk::DestroyBuffer(dev_, static_buf_, nullptr);
+        allocator_->free(static_mem_);
     }
 
-    for (auto cmd_pool: worker_cmd_pools_) vk::DestroyCommandPool(dev_, cmd_pool, nullptr);
-    worker_cmd_pools_.clear();
+    for (auto &data: frame_data_) {
+        if (data.query_pool) vk::DestroyQueryPool(dev_, data.query_pool, nullptr);
+        for (auto &cmds: data.worker_cmds) vk::DestroyCommandPool(dev_, cmds.pool, nullptr);
+    }
     vk::DestroyCommandPool(dev_, primary_cmd_pool_, nullptr);
 
     for (auto &data: frame_data_) vk::DestroyFence(dev_, data.fence, nullptr);
@@ -387,117 +888,233 @@ void Smoke::create_command_buffers() {
     cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     cmd_pool_info.queueFamilyIndex = queue_family_;
 
+    vk::assert_success(vk::CreateCommandPool(dev_, &cmd_pool_info, nullptr, &primary_cmd_pool_));
+
     VkCommandBufferAllocateInfo cmd_info = {};
     cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    cmd_info.commandBufferCount = static_cast<uint32_t>(frame_data_.size());
+    cmd_info.commandPool = primary_cmd_pool_;
+    cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmd_info.commandBufferCount = 1;
 
-    // create command pools and buffers
-    std::vector<VkCommandPool> cmd_pools(workers_.size() + 1, VK_NULL_HANDLE);
-    std::vector<std::vector<VkCommandBuffer>> cmds_vec(workers_.size() + 1,
-                                                       std::vector<VkCommandBuffer>(frame_data_.size(),
-                                                                                    VK_NULL_HANDLE));
-    for (size_t i = 0; i < cmd_pools.size(); i++) {
-        auto &cmd_pool = cmd_pools[i];
-        auto &cmds = cmds_vec[i];
+    // the worker pools are reset as a whole once the frame's fence signals
+    cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
 
-        vk::assert_success(vk::CreateCommandPool(dev_, &cmd_pool_info, nullptr, &cmd_pool));
+    for (auto &data: frame_data_) {
+        vk::assert_success(vk::AllocateCommandBuffers(dev_, &cmd_info, &data.primary_cmd));
 
-        cmd_info.commandPool = cmd_pool;
-        cmd_info.level = (cmd_pool == cmd_pools.back()) ? VK_COMMAND_BUFFER_LEVEL_PRIMARY
-                                                        : VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        data.worker_cmds.resize(workers_.size());
+        for (auto &cmds: data.worker_cmds)
+            vk::assert_success(vk::CreateCommandPool(dev_, &cmd_pool_info, nullptr, &cmds.pool));
 
-        vk::assert_success(vk::AllocateCommandBuffers(dev_, &cmd_info, cmds.data()));
+        data.chunk_cmds.resize(chunks_.size(), VK_NULL_HANDLE);
     }
+}
 
-    // update frame_data_
-    for (size_t i = 0; i < frame_data_.size(); i++) {
-        for (const auto &cmds: cmds_vec) {
-            if (cmds == cmds_vec.back()) {
-                frame_data_[i].primary_cmd = cmds[i];
-            } else {
-                frame_data_[i].worker_cmds.push_back(cmds[i]);
-            }
-        }
-    }
+void Smoke::create_query_pools() {
+    VkQueryPoolCreateInfo query_pool_info = {};
+    query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_info.queryCount = static_cast<uint32_t>(2 + 2 * chunks_.size());
 
-    primary_cmd_pool_ = cmd_pools.back();
-    cmd_pools.pop_back();
-    worker_cmd_pools_ = cmd_pools;
+    for (auto &data: frame_data_) {
+        vk::assert_success(vk::CreateQueryPool(dev_, &query_pool_info, nullptr, &data.query_pool));
+        data.chunk_workers.resize(chunks_.size(), 0);
+        data.timestamps_submitted = false;
+    }
 }
 
 void Smoke::create_buffers() {
-    VkDeviceSize object_data_size = sizeof(ShaderParamBlock);
-    // align object data to device limit
+    VkDeviceSize object_data_size = transform_size(transform_encoding_);
+    // align object data to device limit when addressed through dynamic offsets
     const VkDeviceSize &alignment = physical_dev_props_.limits.minStorageBufferOffsetAlignment;
-    if (object_data_size % alignment) object_data_size += alignment - (object_data_size % alignment);
+    if (draw_mode_ == DRAW_DYNAMIC_OFFSET && object_data_size % alignment)
+        object_data_size += alignment - (object_data_size % alignment);
 
     // update simulation
     sim_.set_frame_data_size(static_cast<uint32_t>(object_data_size));
 
+    auto align_offset = [](VkDeviceSize offset, VkDeviceSize boundary) {
+        return (offset + boundary - 1) / boundary * boundary;
+    };
+
     VkBufferCreateInfo buf_info = {};
     buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    buf_info.size = object_data_size * sim_.objects().size();
-    buf_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    buf_info.size = object_data_size * sim_.object_count();
+    frame_data_object_size_ = object_data_size;
+    buf_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    if (draw_mode_ == DRAW_INSTANCED) {
+        // the transforms are in instance order, followed by the object of each instance
+        instance_objects_offset_ = align_offset(buf_info.size, alignment);
+        buf_info.size = instance_objects_offset_ + sizeof(uint32_t) * sim_.object_count();
+    }
+    if (draw_mode_ == DRAW_INDIRECT) {
+        // the transforms are followed by one draw command per object
+        indirect_offset_ = buf_info.size;
+        buf_info.size = indirect_offset_ + sizeof(VkDrawIndexedIndirectCommand) * sim_.object_count();
+        buf_info.usage |= VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    }
+    if (gpu_cull_) {
+        // the cull shader binds every region, so they start at storage buffer offsets
+        indirect_offset_ = align_offset(object_data_size * sim_.object_count(), alignment);
+        bounds_offset_ = align_offset(indirect_offset_ + sizeof(VkDrawIndexedIndirectCommand) * sim_.object_count(),
+                                      alignment);
+        cull_counts_offset_ = align_offset(bounds_offset_ + sizeof(float) * sim_.object_count(), alignment);
+        visible_draws_offset_ = align_offset(cull_counts_offset_ + sizeof(uint32_t) * 2, alignment);
+        buf_info.size = visible_draws_offset_ + sizeof(VkDrawIndexedIndirectCommand) * sim_.object_count();
+        buf_info.usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    }
+    // the camera goes last
+    camera_offset_ = align_offset(buf_info.size, physical_dev_props_.limits.minUniformBufferOffsetAlignment);
+    buf_info.size = camera_offset_ + sizeof(CameraBlock);
     buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
     for (auto &data: frame_data_) vk::assert_success(vk::CreateBuffer(dev_, &buf_info, nullptr, &data.buf));
 }
 
 void Smoke::create_buffer_memory() {
-    VkMemoryRequirements mem_reqs;
-    vk::GetBufferMemoryRequirements(dev_, frame_data_[0].buf, &mem_reqs);
-
-    frame_data_aligned_size_ = mem_reqs.size;
-    if (frame_data_aligned_size_ % mem_reqs.alignment)
-        frame_data_aligned_size_ += mem_reqs.alignment - (frame_data_aligned_size_ % mem_reqs.alignment);
-
-    // allocate memory
-    VkMemoryAllocateInfo mem_info = {};
-    mem_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    mem_info.allocationSize = frame_data_aligned_size_ * (frame_data_.size() - 1) + mem_reqs.size;
-
-    bool found = false;
-    for (uint32_t idx = 0; idx < mem_flags_.size(); idx++) {
-        if ((mem_reqs.memoryTypeBits & (1 << idx)) && (mem_flags_[idx] & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
-            (mem_flags_[idx] & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
-            mem_info.memoryTypeIndex = idx;
-            found = true;
-            break;
+    for (auto &data: frame_data_) {
+        data.mem = allocator_->allocate_buffer(data.buf,
+                                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        data.base = data.mem.mapped;
+
+        // the draw sources and bounding radii of GPU culling do not change
+        if (gpu_cull_) {
+            auto *draws = reinterpret_cast<VkDrawIndexedIndirectCommand *>(data.base + indirect_offset_);
+            auto *radii = reinterpret_cast<float *>(data.base + bounds_offset_);
+            for (int i = 0; i < sim_.object_count(); i++) {
+                draws[i] = meshes_->draw_command(sim_.meshes()[i]);
+                draws[i].firstInstance = static_cast<uint32_t>(i);
+                radii[i] = meshes_->bounding_radius(sim_.meshes()[i]);
+            }
         }
     }
+}
 
-    if (!found) {
-        throw std::runtime_error("Failed to find suitable memory type (Host Visible + Coherent)!");
-    }
+void Smoke::create_static_buffer() {
+    VkDeviceSize object_size = sizeof(ObjectParams);
+    const VkDeviceSize &alignment = physical_dev_props_.limits.minStorageBufferOffsetAlignment;
+    if (draw_mode_ == DRAW_DYNAMIC_OFFSET && object_size % alignment)
+        object_size += alignment - (object_size % alignment);
+    static_object_size_ = object_size;
 
-    vk::AllocateMemory(dev_, &mem_info, nullptr, &frame_data_mem_);
+    VkBufferCreateInfo buf_info = {};
+    buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buf_info.size = object_size * sim_.object_count();
+    buf_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    vk::assert_success(vk::CreateBuffer(dev_, &buf_info, nullptr, &static_buf_));
 
-    void *ptr;
-    vk::MapMemory(dev_, frame_data_mem_, 0, VK_WHOLE_SIZE, 0, &ptr);
+    VkMemoryRequirements mem_reqs;
+    vk::GetBufferMemoryRequirements(dev_, static_buf_, &mem_reqs);
+
+    // like the meshes, written in place when device-local memory is mappable
+    const VkMemoryPropertyFlags mappable_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    int mem_type = allocator_->find_memory_type(mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | mappable_flags);
+    static_staged_ = false;
+    if (mem_type < 0) {
+        mem_type = allocator_->find_memory_type(mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        static_staged_ = true;
+    }
+    if (mem_type < 0) {
+        mem_type = allocator_->find_memory_type(mem_reqs.memoryTypeBits, mappable_flags);
+        static_staged_ = false;
+    }
+    if (mem_type < 0) throw std::runtime_error("no memory type for object data");
+
+    static_mem_ = allocator_->allocate_type(mem_reqs, static_cast<uint32_t>(mem_type));
+    vk::assert_success(vk::BindBufferMemory(dev_, static_buf_, static_mem_.memory, static_mem_.offset));
+
+    VkBuffer staging_buf = VK_NULL_HANDLE;
+    Allocator::Allocation staging_mem;
+    uint8_t *dst = static_mem_.mapped;
+    if (static_staged_) {
+        buf_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        vk::assert_success(vk::CreateBuffer(dev_, &buf_info, nullptr, &staging_buf));
+        staging_mem = allocator_->allocate_buffer(staging_buf, mappable_flags);
+        dst = staging_mem.mapped;
+    }
 
-    VkDeviceSize offset = 0;
-    for (auto &data: frame_data_) {
-        vk::BindBufferMemory(dev_, data.buf, frame_data_mem_, offset);
-        data.base = reinterpret_cast<uint8_t *>(ptr) + offset;
-        offset += frame_data_aligned_size_;
+    for (int i = 0; i < sim_.object_count(); i++) {
+        auto *params = reinterpret_cast<ObjectParams *>(dst + object_size * i);
+        memcpy(params->light_pos, glm::value_ptr(sim_.light_positions()[i]), sizeof(glm::vec3));
+        memcpy(params->light_color, glm::value_ptr(sim_.light_colors()[i]), sizeof(glm::vec3));
     }
+
+    if (!static_staged_) return;
+
+    VkCommandBufferAllocateInfo cmd_info = {};
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmd_info.commandPool = primary_cmd_pool_;
+    cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmd_info.commandBufferCount = 1;
+
+    VkCommandBuffer cmd;
+    vk::assert_success(vk::AllocateCommandBuffers(dev_, &cmd_info, &cmd));
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vk::assert_success(vk::BeginCommandBuffer(cmd, &begin_info));
+
+    VkBufferCopy copy = {0, 0, buf_info.size};
+    vk::CmdCopyBuffer(cmd, staging_buf, static_buf_, 1, &copy);
+
+    VkBufferMemoryBarrier buf_barrier = {};
+    buf_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    buf_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    buf_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    buf_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buf_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buf_barrier.buffer = static_buf_;
+    buf_barrier.offset = 0;
+    buf_barrier.size = VK_WHOLE_SIZE;
+    vk::CmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0, nullptr, 1,
+                           &buf_barrier, 0, nullptr);
+
+    vk::assert_success(vk::EndCommandBuffer(cmd));
+
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkFence fence;
+    vk::assert_success(vk::CreateFence(dev_, &fence_info, nullptr, &fence));
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &cmd;
+    vk::assert_success(vk::QueueSubmit(queue_, 1, &submit_info, fence));
+    vk::assert_success(vk::WaitForFences(dev_, 1, &fence, true, UINT64_MAX));
+
+    vk::DestroyFence(dev_, fence, nullptr);
+    vk::FreeCommandBuffers(dev_, primary_cmd_pool_, 1, &cmd);
+    vk::DestroyBuffer(dev_, staging_buf, nullptr);
+    allocator_->free(staging_mem);
 }
 
 void Smoke::create_descriptor_sets() {
-    VkDescriptorPoolSize desc_pool_size = {};
-    desc_pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
-    desc_pool_size.descriptorCount = static_cast<uint32_t>(frame_data_.size());
+    const auto frame_count = static_cast<uint32_t>(frame_data_.size());
+
+    std::vector<VkDescriptorPoolSize> desc_pool_sizes;
+    desc_pool_sizes.push_back({VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frame_count});
+    desc_pool_sizes.push_back({frame_data_descriptor_type(), frame_count * 2});
+    const uint32_t storage_count = ((draw_mode_ == DRAW_INSTANCED) ? 1 : 0) + (gpu_cull_ ? 5 : 0);
+    if (storage_count) desc_pool_sizes.push_back({VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frame_count * storage_count});
 
     VkDescriptorPoolCreateInfo desc_pool_info = {};
     desc_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    desc_pool_info.maxSets = static_cast<uint32_t>(frame_data_.size());
-    desc_pool_info.poolSizeCount = 1;
-    desc_pool_info.pPoolSizes = &desc_pool_size;
+    desc_pool_info.maxSets = frame_count * (gpu_cull_ ? 3 : 2);
+    desc_pool_info.poolSizeCount = static_cast<uint32_t>(desc_pool_sizes.size());
+    desc_pool_info.pPoolSizes = desc_pool_sizes.data();
 
     // create descriptor pool
     vk::assert_success(vk::CreateDescriptorPool(dev_, &desc_pool_info, nullptr, &desc_pool_));
 
-    std::vector<VkDescriptorSetLayout> set_layouts(frame_data_.size(), desc_set_layout_);
+    // a camera set and an object set per frame
+    std::vector<VkDescriptorSetLayout> set_layouts;
+    for (uint32_t i = 0; i < frame_count; i++) {
+        set_layouts.push_back(camera_desc_set_layout_);
+        set_layouts.push_back(desc_set_layout_);
+    }
     VkDescriptorSetAllocateInfo set_info = {};
     set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     set_info.descriptorPool = desc_pool_;
@@ -505,42 +1122,112 @@ void Smoke::create_descriptor_sets() {
     set_info.pSetLayouts = set_layouts.data();
 
     // create descriptor sets
-    std::vector<VkDescriptorSet> desc_sets(frame_data_.size(), VK_NULL_HANDLE);
+    std::vector<VkDescriptorSet> desc_sets(set_layouts.size(), VK_NULL_HANDLE);
     vk::assert_success(vk::AllocateDescriptorSets(dev_, &set_info, desc_sets.data()));
 
-    std::vector<VkDescriptorBufferInfo> desc_buffs(frame_data_.size());
-    std::vector<VkWriteDescriptorSet> desc_writes(frame_data_.size());
+    constexpr size_t writes_per_frame = 4;
+    std::vector<VkDescriptorBufferInfo> desc_buffs(frame_data_.size() * writes_per_frame);
+    std::vector<VkWriteDescriptorSet> desc_writes;
 
     for (size_t i = 0; i < frame_data_.size(); i++) {
         auto &data = frame_data_[i];
 
-        data.desc_set = desc_sets[i];
-
-        VkDescriptorBufferInfo desc_buf = {};
-        desc_buf.buffer = data.buf;
-        desc_buf.offset = 0;
-        desc_buf.range = VK_WHOLE_SIZE;
-        desc_buffs[i] = desc_buf;
+        data.camera_desc_set = desc_sets[2 * i];
+        data.desc_set = desc_sets[2 * i + 1];
+
+        VkDescriptorBufferInfo *bufs = &desc_buffs[i * writes_per_frame];
+        bufs[0] = {data.buf, camera_offset_, sizeof(CameraBlock)};
+        // only one object is visible at a time through the dynamic offset,
+        // which keeps large object counts under maxStorageBufferRange
+        bufs[1] = {data.buf, 0,
+                   (draw_mode_ == DRAW_DYNAMIC_OFFSET) ? frame_data_object_size_
+                                                       : frame_data_object_size_ * sim_.object_count()};
+        bufs[2] = {static_buf_, 0,
+                   (draw_mode_ == DRAW_DYNAMIC_OFFSET) ? static_object_size_
+                                                       : static_object_size_ * sim_.object_count()};
+        bufs[3] = {data.buf, instance_objects_offset_, sizeof(uint32_t) * sim_.object_count()};
 
         VkWriteDescriptorSet desc_write = {};
         desc_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        desc_write.dstSet = data.desc_set;
+        desc_write.dstSet = data.camera_desc_set;
         desc_write.dstBinding = 0;
         desc_write.dstArrayElement = 0;
         desc_write.descriptorCount = 1;
-        desc_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
-        desc_write.pBufferInfo = &desc_buffs[i];
-        desc_writes[i] = desc_write;
+        desc_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        desc_write.pBufferInfo = &bufs[0];
+        desc_writes.push_back(desc_write);
+
+        desc_write.dstSet = data.desc_set;
+        desc_write.descriptorType = frame_data_descriptor_type();
+        desc_write.pBufferInfo = &bufs[1];
+        desc_writes.push_back(desc_write);
+
+        desc_write.dstBinding = 1;
+        desc_write.pBufferInfo = &bufs[2];
+        desc_writes.push_back(desc_write);
+
+        if (draw_mode_ == DRAW_INSTANCED) {
+            desc_write.dstBinding = 2;
+            desc_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            desc_write.pBufferInfo = &bufs[3];
+            desc_writes.push_back(desc_write);
+        }
     }
 
     vk::UpdateDescriptorSets(dev_, static_cast<uint32_t>(desc_writes.size()), desc_writes.data(), 0, nullptr);
+
+    if (!gpu_cull_) return;
+
+    std::vector<VkDescriptorSetLayout> cull_set_layouts(frame_data_.size(), cull_desc_set_layout_);
+    set_info.descriptorSetCount = static_cast<uint32_t>(cull_set_layouts.size());
+    set_info.pSetLayouts = cull_set_layouts.data();
+    vk::assert_success(vk::AllocateDescriptorSets(dev_, &set_info, desc_sets.data()));
+
+    const VkDeviceSize draws_size = sizeof(VkDrawIndexedIndirectCommand) * sim_.object_count();
+    const std::array<std::pair<VkDeviceSize, VkDeviceSize>, 5> regions = {{
+        {0, frame_data_object_size_ * sim_.object_count()},
+        {indirect_offset_, draws_size},
+        {bounds_offset_, sizeof(float) * sim_.object_count()},
+        {cull_counts_offset_, sizeof(uint32_t) * 2},
+        {visible_draws_offset_, draws_size},
+    }};
+
+    std::vector<VkDescriptorBufferInfo> cull_desc_buffs(frame_data_.size() * regions.size());
+    std::vector<VkWriteDescriptorSet> cull_desc_writes(frame_data_.size() * regions.size());
+
+    for (size_t i = 0; i < frame_data_.size(); i++) {
+        auto &data = frame_data_[i];
+
+        data.cull_desc_set = desc_sets[i];
+
+        for (size_t j = 0; j < regions.size(); j++) {
+            const size_t k = i * regions.size() + j;
+
+            cull_desc_buffs[k].buffer = data.buf;
+            cull_desc_buffs[k].offset = regions[j].first;
+            cull_desc_buffs[k].range = regions[j].second;
+
+            VkWriteDescriptorSet desc_write = {};
+            desc_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            desc_write.dstSet = data.cull_desc_set;
+            desc_write.dstBinding = static_cast<uint32_t>(j);
+            desc_write.dstArrayElement = 0;
+            desc_write.descriptorCount = 1;
+            desc_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            desc_write.pBufferInfo = &cull_desc_buffs[k];
+            cull_desc_writes[k] = desc_write;
+        }
+    }
+
+    vk::UpdateDescriptorSets(dev_, static_cast<uint32_t>(cull_desc_writes.size()), cull_desc_writes.data(), 0,
+                             nullptr);
 }
 
 void Smoke::attach_swapchain() {
     const Shell::Context &ctx = shell_->context();
 
     prepare_viewport(ctx.extent);
-    prepare_framebuffers(ctx.swapchain);
+    prepare_framebuffers(ctx.images);
 
     update_camera();
 }
@@ -568,9 +1255,9 @@ void Smoke::prepare_viewport(const VkExtent2D &extent) {
     scissor_.extent = extent_;
 }
 
-void Smoke::prepare_framebuffers(VkSwapchainKHR swapchain) {
-    // get swapchain images
-    vk::get(dev_, swapchain, images_);
+void Smoke::prepare_framebuffers(const std::vector<VkImage> &images) {
+    // swapchain or offscreen images
+    images_ = images;
 
     assert(framebuffers_.empty());
     image_views_.reserve(images_.size());
@@ -617,51 +1304,380 @@ void Smoke::update_camera() {
                          1.0f);
 
     camera_.view_projection = clip * projection * view;
+
+    // the planes are combinations of the rows of view_projection; clip space
+    // z goes from 0 to w in Vulkan
+    const glm::mat4 &m = camera_.view_projection;
+    const glm::vec4 row_x(m[0][0], m[1][0], m[2][0], m[3][0]);
+    const glm::vec4 row_y(m[0][1], m[1][1], m[2][1], m[3][1]);
+    const glm::vec4 row_z(m[0][2], m[1][2], m[2][2], m[3][2]);
+    const glm::vec4 row_w(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    camera_.frustum_planes = {{row_w + row_x, row_w - row_x, row_w + row_y, row_w - row_y, row_z, row_w - row_z}};
+    for (auto &plane: camera_.frustum_planes) plane /= glm::length(glm::vec3(plane));
 }
 
-void Smoke::draw_object(const Simulation::Object &obj, FrameData &data, VkCommandBuffer cmd) const {
-    if (use_push_constants_) {
+void Smoke::draw_object(int index, FrameData &data, VkCommandBuffer cmd) const {
+    // the shader indexes the object data with gl_InstanceIndex, so nothing is bound per object
+    if (draw_mode_ == DRAW_FIRST_INSTANCE) {
+        write_transform(index, data.base + sim_.frame_data_offsets()[index]);
+        meshes_->cmd_draw_instanced(cmd, sim_.meshes()[index], 1, index);
+        return;
+    }
+
+    if (draw_mode_ == DRAW_PUSH_CONSTANTS) {
+        const glm::mat4 &model = sim_.models()[index];
+        const glm::vec3 &light_pos = sim_.light_positions()[index];
+        const glm::vec3 &light_color = sim_.light_colors()[index];
+
         ShaderParamBlock params{};
-        memcpy(params.light_pos, glm::value_ptr(obj.light_pos), sizeof(obj.light_pos));
-        memcpy(params.light_color, glm::value_ptr(obj.light_color), sizeof(obj.light_color));
-        memcpy(params.model, glm::value_ptr(obj.model), sizeof(obj.model));
+        memcpy(params.light_pos, glm::value_ptr(light_pos), sizeof(light_pos));
+        memcpy(params.light_color, glm::value_ptr(light_color), sizeof(light_color));
+        memcpy(params.model, glm::value_ptr(model), sizeof(model));
         memcpy(params.view_projection, glm::value_ptr(camera_.view_projection), sizeof(camera_.view_projection));
 
         vk::CmdPushConstants(cmd, pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(params), &params);
     } else {
-        auto *params = reinterpret_cast<ShaderParamBlock *>(data.base + obj.frame_data_offset);
-        memcpy(params->light_pos, glm::value_ptr(obj.light_pos), sizeof(obj.light_pos));
-        memcpy(params->light_color, glm::value_ptr(obj.light_color), sizeof(obj.light_color));
-        memcpy(params->model, glm::value_ptr(obj.model), sizeof(obj.model));
-        memcpy(params->view_projection, glm::value_ptr(camera_.view_projection), sizeof(camera_.view_projection));
+        const uint32_t &frame_data_offset = sim_.frame_data_offsets()[index];
+
+        write_transform(index, data.base + frame_data_offset);
+
+        const std::array<uint32_t, 2> offsets = {frame_data_offset,
+                                                 static_cast<uint32_t>(static_object_size_ * index)};
+        vk::CmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_, 1, 1, &data.desc_set,
+                                  static_cast<uint32_t>(offsets.size()), offsets.data());
+    }
+
+    meshes_->cmd_draw(cmd, sim_.meshes()[index]);
+}
+
+void Smoke::write_transform(int index, uint8_t *dst) const {
+    switch (transform_encoding_) {
+        case TRANSFORM_MAT4:
+            memcpy(dst, glm::value_ptr(sim_.models()[index]), sizeof(ObjectTransform));
+            break;
+        case TRANSFORM_AFFINE: {
+            const glm::mat4 &model = sim_.models()[index];
+            auto *transform = reinterpret_cast<AffineTransform *>(dst);
+            for (int row = 0; row < 3; row++) {
+                for (int col = 0; col < 4; col++) transform->rows[row][col] = model[col][row];
+            }
+            break;
+        }
+        case TRANSFORM_QUAT:
+            memcpy(dst, &sim_.poses()[index], sizeof(QuatTransform));
+            break;
+        case TRANSFORM_QUAT_HALF: {
+            const Pose &pose = sim_.poses()[index];
+            auto *transform = reinterpret_cast<HalfQuatTransform *>(dst);
+            transform->halves[0] = glm::packHalf2x16(glm::vec2(pose.position.x, pose.position.y));
+            transform->halves[1] = glm::packHalf2x16(glm::vec2(pose.position.z, pose.scale));
+            transform->halves[2] = glm::packHalf2x16(glm::vec2(pose.orientation.x, pose.orientation.y));
+            transform->halves[3] = glm::packHalf2x16(glm::vec2(pose.orientation.z, pose.orientation.w));
+            break;
+        }
+    }
+}
+
+void Smoke::draw_instanced(const Chunk &chunk, FrameData &data, VkCommandBuffer cmd) const {
+    std::array<int, Meshes::MESH_COUNT> mesh_counts = chunk.mesh_counts;
+    if (cpu_cull_) {
+        mesh_counts = {};
+        for (int i = chunk.object_begin; i < chunk.object_end; i++) {
+            if (is_visible(i)) mesh_counts[sim_.meshes()[i]]++;
+        }
+    }
+
+    // the chunk's slice of the buffer is laid out mesh by mesh
+    std::array<int, Meshes::MESH_COUNT> first_instance{};
+    int first = chunk.object_begin;
+    for (int type = 0; type < Meshes::MESH_COUNT; type++) {
+        first_instance[type] = first;
+        first += mesh_counts[type];
+    }
+
+    std::array<int, Meshes::MESH_COUNT> next_instance = first_instance;
+    auto *instance_objects = reinterpret_cast<uint32_t *>(data.base + instance_objects_offset_);
+    for (int i = chunk.object_begin; i < chunk.object_end; i++) {
+        if (!is_visible(i)) continue;
+
+        const int instance = next_instance[sim_.meshes()[i]]++;
+
+        write_transform(i, data.base + instance * frame_data_object_size_);
+        instance_objects[instance] = static_cast<uint32_t>(i);
+    }
+
+    for (int type = 0; type < Meshes::MESH_COUNT; type++) {
+        if (!mesh_counts[type]) continue;
+
+        meshes_->cmd_draw_instanced(cmd, static_cast<Meshes::Type>(type), mesh_counts[type], first_instance[type]);
+    }
+}
+
+void Smoke::cmd_cull(const FrameData &data) const {
+    VkCommandBuffer cmd = data.primary_cmd;
+
+    vk::CmdFillBuffer(cmd, data.buf, cull_counts_offset_, sizeof(uint32_t) * 2, 0);
+
+    VkBufferMemoryBarrier buf_barrier = {};
+    buf_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    buf_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    buf_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    buf_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buf_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buf_barrier.buffer = data.buf;
+    buf_barrier.offset = cull_counts_offset_;
+    buf_barrier.size = sizeof(uint32_t) * 2;
+    vk::CmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1,
+                           &buf_barrier, 0, nullptr);
+
+    CullPushConstants push_consts{};
+    for (size_t i = 0; i < camera_.frustum_planes.size(); i++)
+        memcpy(push_consts.frustum_planes[i], glm::value_ptr(camera_.frustum_planes[i]), sizeof(glm::vec4));
+    push_consts.object_count = static_cast<uint32_t>(sim_.object_count());
+
+    vk::CmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline_);
+    vk::CmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline_layout_, 0, 1, &data.cull_desc_set, 0,
+                              nullptr);
+    vk::CmdPushConstants(cmd, cull_pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_consts),
+                         &push_consts);
+    vk::CmdDispatch(cmd, (push_consts.object_count + 63) / 64, 1, 1);
+
+    // the counts and the compacted draws feed the indirect draw
+    buf_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    buf_barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    buf_barrier.offset = cull_counts_offset_;
+    buf_barrier.size = VK_WHOLE_SIZE;
+    vk::CmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0,
+                           nullptr, 1, &buf_barrier, 0, nullptr);
+}
+
+void Smoke::cmd_draw_culled(const FrameData &data) const {
+    VkCommandBuffer cmd = data.primary_cmd;
+
+    vk::CmdSetViewport(cmd, 0, 1, &viewport_);
+    vk::CmdSetScissor(cmd, 0, 1, &scissor_);
+
+    vk::CmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_);
+
+    meshes_->cmd_bind_buffers(cmd);
 
-        vk::CmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_, 0, 1, &data.desc_set, 1,
-                                  &obj.frame_data_offset);
+    const std::array<VkDescriptorSet, 2> desc_sets = {data.camera_desc_set, data.desc_set};
+    vk::CmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_, 0,
+                              static_cast<uint32_t>(desc_sets.size()), desc_sets.data(), 0, nullptr);
+
+    vk::CmdDrawIndexedIndirectCountKHR(cmd, data.buf, visible_draws_offset_, data.buf, cull_counts_offset_,
+                                       static_cast<uint32_t>(sim_.object_count()),
+                                       sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void Smoke::read_cull_stats(const FrameData &data) {
+    const auto *counts = reinterpret_cast<const uint32_t *>(data.base + cull_counts_offset_);
+    cull_visible_count_ += counts[0];
+    cull_culled_count_ += counts[1];
+    cull_frame_count_++;
+}
+
+void Smoke::read_timestamps(const FrameData &data) {
+    // no chunk records GPU work when the primary command buffer draws the culled objects
+    const size_t chunk_count = gpu_cull_ ? 0 : chunks_.size();
+    std::vector<uint64_t> ticks(2 + 2 * chunk_count);
+
+    // the fence has signaled, so this does not wait
+    const VkResult res = vk::GetQueryPoolResults(dev_, data.query_pool, 0, static_cast<uint32_t>(ticks.size()),
+                                                 sizeof(uint64_t) * ticks.size(), ticks.data(), sizeof(uint64_t),
+                                                 VK_QUERY_RESULT_64_BIT);
+    if (res != VK_SUCCESS) return;
+
+    const auto elapsed_ms = [this](uint64_t begin, uint64_t end) {
+        return static_cast<double>((end - begin) & timestamp_mask_) * timestamp_period_ / 1e6;
+    };
+
+    const double frame_time = elapsed_ms(ticks[0], ticks[1]);
+    gpu_frame_total_ += frame_time;
+    gpu_frame_max_ = std::max(gpu_frame_max_, frame_time);
+    gpu_frame_count_++;
+
+    for (size_t i = 0; i < chunk_count; i++)
+        worker_gpu_time_[data.chunk_workers[i]] += elapsed_ms(ticks[2 + 2 * i], ticks[2 + 2 * i + 1]);
+}
+
+std::string Smoke::take_frame_stats() {
+    // the workers own their counters while they run
+    wait_workers();
+
+    std::stringstream ss;
+    if (multithread_) {
+        ss << "(steals:";
+        for (auto &work: workers_) ss << " " << work->steal_count_;
+        ss << ", busy ms:" << std::fixed << std::setprecision(1);
+        for (auto &work: workers_) ss << " " << work->busy_time_;
+        ss << ") ";
+
+        for (auto &work: workers_) {
+            work->steal_count_ = 0;
+            work->busy_time_ = 0.0;
+        }
     }
 
-    meshes_->cmd_draw(cmd, obj.mesh);
+    if (fence_wait_count_) {
+        ss << std::fixed << std::setprecision(3) << "(cpu: " << cpu_frame_total_ / fence_wait_count_
+           << " ms avg) (fence wait: " << fence_wait_total_ / fence_wait_count_ << " ms avg, " << fence_wait_max_
+           << " ms max)";
+
+        if (draw_mode_ != DRAW_PUSH_CONSTANTS) {
+            uint64_t streamed_bytes = 0;
+            for (auto &work: workers_) {
+                streamed_bytes += work->streamed_bytes_;
+                work->streamed_bytes_ = 0;
+            }
+            ss << std::setprecision(1) << " (transforms: "
+               << static_cast<double>(streamed_bytes) / fence_wait_count_ / 1024.0 << " KiB per frame)";
+        }
+
+        cpu_frame_total_ = 0.0;
+        fence_wait_total_ = 0.0;
+        fence_wait_max_ = 0.0;
+        fence_wait_count_ = 0;
+    }
+
+    if (gpu_frame_count_) {
+        ss << std::fixed << std::setprecision(3) << " (gpu: " << gpu_frame_total_ / gpu_frame_count_ << " ms avg, "
+           << gpu_frame_max_ << " ms max";
+        if (!gpu_cull_) {
+            ss << ", per worker:";
+            for (auto &time: worker_gpu_time_) {
+                ss << " " << time / gpu_frame_count_;
+                time = 0.0;
+            }
+        }
+        ss << ")";
+
+        gpu_frame_total_ = 0.0;
+        gpu_frame_max_ = 0.0;
+        gpu_frame_count_ = 0;
+    }
+
+    if (!cull_frame_count_) return ss.str();
+
+    ss << " ";
+    if (cpu_cull_) {
+        // by the worker that recorded the chunks, like the steals and busy times
+        uint64_t visible_count = 0;
+        ss << "(visible per worker:";
+        for (auto &work: workers_) {
+            ss << " " << work->visible_total_ / cull_frame_count_;
+            visible_count += work->visible_total_;
+            work->visible_total_ = 0;
+        }
+        ss << ", culled: " << sim_.object_count() - visible_count / cull_frame_count_ << ")";
+
+        cull_frame_count_ = 0;
+
+        return ss.str();
+    }
+
+    ss << "(visible: " << cull_visible_count_ / cull_frame_count_ << ", culled: "
+       << cull_culled_count_ / cull_frame_count_ << ")";
+
+    cull_visible_count_ = 0;
+    cull_culled_count_ = 0;
+    cull_frame_count_ = 0;
+
+    return ss.str();
 }
 
-void Smoke::update_simulation(const Worker &work) {
-    sim_.update(work.tick_interval_, work.object_begin_, work.object_end_);
+void Smoke::draw_indirect(const Chunk &chunk, FrameData &data, VkCommandBuffer cmd) const {
+    auto *draws = reinterpret_cast<VkDrawIndexedIndirectCommand *>(data.base + indirect_offset_);
+    int next_draw = chunk.object_begin;
+    for (int i = chunk.object_begin; i < chunk.object_end; i++) {
+        if (!is_visible(i)) continue;
+
+        write_transform(i, data.base + sim_.frame_data_offsets()[i]);
+
+        auto &draw = draws[next_draw++];
+        draw = meshes_->draw_command(sim_.meshes()[i]);
+        draw.firstInstance = static_cast<uint32_t>(i);
+    }
+
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    const VkDeviceSize offset = indirect_offset_ + stride * chunk.object_begin;
+    const auto draw_count = static_cast<uint32_t>(next_draw - chunk.object_begin);
+    if (!draw_count) return;
+
+    // the CPU knows the count, so a count buffer would not save anything
+    const uint32_t max_draw_count = multi_draw_indirect_ ? physical_dev_props_.limits.maxDrawIndirectCount : 1;
+    for (uint32_t first = 0; first < draw_count; first += max_draw_count) {
+        vk::CmdDrawIndexedIndirect(cmd, data.buf, offset + stride * first, std::min(max_draw_count, draw_count - first),
+                                   stride);
+    }
+}
+
+void Smoke::run_item(Worker &work, WorkerJob job, int item) {
+    // draws and steps alternate so that every worker is dealt some of both;
+    // the draws are popped first and the steps are left for thieves
+    if (job == JOB_STEP_DRAW) {
+        job = (item % 2) ? JOB_STEP : JOB_DRAW;
+        item /= 2;
+    }
+
+    const Chunk &chunk = chunks_[item];
+    TraceScope trace((job == JOB_STEP) ? "step" : "draw", chunk.index);
+    if (job == JOB_STEP)
+        update_simulation(chunk);
+    else if (job == JOB_DRAW)
+        draw_objects(work, chunk);
 }
 
-void Smoke::draw_objects(Worker &work) {
+void Smoke::update_simulation(const Chunk &chunk) {
+    sim_.update(1.0f / (float) settings_.ticks_per_second, chunk.object_begin, chunk.object_end);
+}
+
+void Smoke::draw_objects(Worker &work, const Chunk &chunk) {
     auto &data = frame_data_[frame_data_index_];
-    auto cmd = data.worker_cmds[work.index_];
+
+    // the cull shader picks the draws and the primary command buffer records
+    // them, so only the transforms are left
+    if (gpu_cull_) {
+        sim_.interpolate(frame_pred_, chunk.object_begin, chunk.object_end);
+        for (int i = chunk.object_begin; i < chunk.object_end; i++)
+            write_transform(i, data.base + sim_.frame_data_offsets()[i]);
+        work.streamed_bytes_ += frame_data_object_size_ * (chunk.object_end - chunk.object_begin);
+        return;
+    }
+
+    // only this worker allocates from its pool
+    auto &cmds = data.worker_cmds[work.index_];
+    if (cmds.used == cmds.cmds.size()) {
+        VkCommandBufferAllocateInfo cmd_info = {};
+        cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cmd_info.commandPool = cmds.pool;
+        cmd_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        cmd_info.commandBufferCount = 1;
+
+        VkCommandBuffer cmd;
+        vk::assert_success(vk::AllocateCommandBuffers(dev_, &cmd_info, &cmd));
+        cmds.cmds.push_back(cmd);
+    }
+    auto cmd = cmds.cmds[cmds.used++];
+    data.chunk_cmds[chunk.index] = cmd;
+    if (timestamps_) data.chunk_workers[chunk.index] = work.index_;
 
     VkCommandBufferInheritanceInfo inherit_info = {};
     inherit_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
     inherit_info.renderPass = render_pass_;
-    inherit_info.framebuffer = work.fb_;
+    inherit_info.framebuffer = worker_fb_;
 
     VkCommandBufferBeginInfo begin_info = {};
     begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
     begin_info.pInheritanceInfo = &inherit_info;
 
     vk::BeginCommandBuffer(cmd, &begin_info);
 
+    const auto query = static_cast<uint32_t>(2 + 2 * chunk.index);
+    if (timestamps_) vk::CmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, data.query_pool, query);
+
     vk::CmdSetViewport(cmd, 0, 1, &viewport_);
     vk::CmdSetScissor(cmd, 0, 1, &scissor_);
 
@@ -669,12 +1685,36 @@ void Smoke::draw_objects(Worker &work) {
 
     meshes_->cmd_bind_buffers(cmd);
 
-    for (int i = work.object_begin_; i < work.object_end_; i++) {
-        auto &obj = sim_.objects()[i];
+    sim_.interpolate(frame_pred_, chunk.object_begin, chunk.object_end);
 
-        draw_object(obj, data, cmd);
+    int visible_count = chunk.object_end - chunk.object_begin;
+    if (cpu_cull_) {
+        visible_count = sim_.cull(camera_.frustum_planes, chunk.object_begin, chunk.object_end,
+                                  &cull_visible_[chunk.object_begin]);
+        work.visible_total_ += visible_count;
+    }
+    if (draw_mode_ != DRAW_PUSH_CONSTANTS) work.streamed_bytes_ += frame_data_object_size_ * visible_count;
+
+    // the camera, and the objects unless they are bound one by one through dynamic offsets
+    if (draw_mode_ != DRAW_PUSH_CONSTANTS) {
+        const std::array<VkDescriptorSet, 2> desc_sets = {data.camera_desc_set, data.desc_set};
+        const uint32_t set_count = (draw_mode_ == DRAW_DYNAMIC_OFFSET) ? 1 : 2;
+        vk::CmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_, 0, set_count,
+                                  desc_sets.data(), 0, nullptr);
+    }
+
+    if (draw_mode_ == DRAW_INSTANCED) {
+        draw_instanced(chunk, data, cmd);
+    } else if (draw_mode_ == DRAW_INDIRECT) {
+        draw_indirect(chunk, data, cmd);
+    } else {
+        for (int i = chunk.object_begin; i < chunk.object_end; i++) {
+            if (is_visible(i)) draw_object(i, data, cmd);
+        }
     }
 
+    if (timestamps_) vk::CmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, data.query_pool, query + 1);
+
     vk::EndCommandBuffer(cmd);
 }
 
@@ -703,71 +1743,160 @@ void Smoke::on_key(Key key) {
 void Smoke::on_tick() {
     if (sim_paused_) return;
 
-    for (auto &work: workers_) work->update_simulation();
+    TraceScope trace("tick");
+
+    if (pipelined_) {
+        // a tick that no frame picked up, e.g. when catching up, runs on its own
+        flush_step();
+        step_pending_ = true;
+    } else {
+        dispatch_workers(JOB_STEP);
+    }
+
+    tick_count_++;
+    if (settings_.hash_interval > 0 && tick_count_ % settings_.hash_interval == 0) {
+        flush_step();
+        log_state_hash();
+    }
+}
+
+void Smoke::log_state_hash() {
+    wait_workers();
+
+    std::stringstream ss;
+    ss << "tick " << tick_count_ << " state hash " << std::hex << std::setw(16) << std::setfill('0')
+       << sim_.state_hash();
+    shell_->log(Shell::LOG_INFO, ss.str().c_str());
 }
 
 void Smoke::on_frame(float frame_pred) {
+    TraceScope trace("frame");
+    const auto frame_start = std::chrono::steady_clock::now();
     frame_count++;
 
     // Limit the number of frames if argument was specified
     if (settings_.max_frame_count != -1 && frame_count == settings_.max_frame_count) {
         // Tell the Game we're done after this frame is drawn.
+        // The stats and the workers' trace rings are read on quit.
+        wait_workers();
         Game::quit();
     }
 
     auto &data = frame_data_[frame_data_index_];
 
     // wait for the last submission since we reuse frame data
-    vk::assert_success(vk::WaitForFences(dev_, 1, &data.fence, true, UINT64_MAX));
+    const auto wait_start = std::chrono::steady_clock::now();
+    {
+        TraceScope wait_trace("fence wait");
+        vk::assert_success(vk::WaitForFences(dev_, 1, &data.fence, true, UINT64_MAX));
+    }
+    const std::chrono::duration<double, std::milli> wait_time = std::chrono::steady_clock::now() - wait_start;
+    fence_wait_total_ += wait_time.count();
+    fence_wait_max_ = std::max(fence_wait_max_, wait_time.count());
+    fence_wait_count_++;
+    frame_stats_.record(FrameStats::PHASE_FENCE_WAIT, wait_time.count());
     vk::assert_success(vk::ResetFences(dev_, 1, &data.fence));
+    const auto record_start = std::chrono::steady_clock::now();
+
+    for (auto &cmds: data.worker_cmds) {
+        vk::assert_success(vk::ResetCommandPool(dev_, cmds.pool, 0));
+        cmds.used = 0;
+    }
+
+    if (data.cull_submitted) read_cull_stats(data);
+    if (data.timestamps_submitted) read_timestamps(data);
+    if (cpu_cull_) cull_frame_count_++;
 
     const Shell::BackBuffer &back = shell_->context().acquired_back_buffer;
 
-    // ignore frame_pred
-    for (auto &work: workers_) work->draw_objects(framebuffers_[back.image_index]);
+    if (draw_mode_ != DRAW_PUSH_CONSTANTS) {
+        auto *camera = reinterpret_cast<CameraBlock *>(data.base + camera_offset_);
+        memcpy(camera->view_projection, glm::value_ptr(camera_.view_projection), sizeof(camera_.view_projection));
+    }
+
+    // blend the last two published ticks, which lag the shell's clock by one tick
+    frame_pred_ = std::clamp(frame_pred, 0.0f, 1.0f);
+    if (step_pending_) {
+        // draw the current published tick while the pending one is stepped;
+        // blending from the previous one would step back in time, since the
+        // last frame was drawn close to alpha 1 of the same pair
+        frame_pred_ = 1.0f;
+        dispatch_workers(JOB_STEP_DRAW, framebuffers_[back.image_index]);
+        step_pending_ = false;
+    } else {
+        dispatch_workers(JOB_DRAW, framebuffers_[back.image_index]);
+    }
 
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "UnusedValue"
     VkResult res = vk::BeginCommandBuffer(data.primary_cmd, &primary_cmd_begin_info_);
 #pragma clang diagnostic pop
 
-    if (!use_push_constants_) {
+    if (timestamps_) {
+        vk::CmdResetQueryPool(data.primary_cmd, data.query_pool, 0, static_cast<uint32_t>(2 + 2 * chunks_.size()));
+        vk::CmdWriteTimestamp(data.primary_cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, data.query_pool, 0);
+    }
+
+    if (draw_mode_ != DRAW_PUSH_CONSTANTS) {
         VkBufferMemoryBarrier buf_barrier = {};
         buf_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
         buf_barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
         buf_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        if (draw_mode_ == DRAW_INDIRECT) buf_barrier.dstAccessMask |= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
         buf_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
         buf_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
         buf_barrier.buffer = data.buf;
         buf_barrier.offset = 0;
         buf_barrier.size = VK_WHOLE_SIZE;
-        vk::CmdPipelineBarrier(data.primary_cmd, VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0,
+        VkPipelineStageFlags dst_stages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+        if (draw_mode_ == DRAW_INDIRECT) dst_stages |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+        if (gpu_cull_) dst_stages |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        vk::CmdPipelineBarrier(data.primary_cmd, VK_PIPELINE_STAGE_HOST_BIT, dst_stages, 0, 0,
                                nullptr, 1,
                                &buf_barrier, 0, nullptr);
     }
 
+    if (gpu_cull_) cmd_cull(data);
+
     render_pass_begin_info_.framebuffer = framebuffers_[back.image_index];
     render_pass_begin_info_.renderArea.extent = extent_;
-    vk::CmdBeginRenderPass(data.primary_cmd, &render_pass_begin_info_, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    vk::CmdBeginRenderPass(data.primary_cmd, &render_pass_begin_info_,
+                           gpu_cull_ ? VK_SUBPASS_CONTENTS_INLINE : VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
     // record render pass commands
-    for (auto &work: workers_) work->wait_idle();
+    wait_workers();
 
     // Flush buffers if enabled
     if (settings_.flush_buffers) {
         VkMappedMemoryRange range = {};
         range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
         range.pNext = nullptr;
-        range.memory = frame_data_mem_;
-        range.offset = frame_data_index_ * frame_data_aligned_size_;
-        range.size = frame_data_aligned_size_;
+        range.memory = data.mem.memory;
+        range.offset = data.mem.offset;
+        range.size = data.mem.size;
 
         vk::FlushMappedMemoryRanges(dev_, 1, &range);
     }
 
-    vk::CmdExecuteCommands(data.primary_cmd, static_cast<uint32_t>(data.worker_cmds.size()), data.worker_cmds.data());
+    if (gpu_cull_)
+        cmd_draw_culled(data);
+    else
+        vk::CmdExecuteCommands(data.primary_cmd, static_cast<uint32_t>(data.chunk_cmds.size()), data.chunk_cmds.data());
 
     vk::CmdEndRenderPass(data.primary_cmd);
+
+    if (gpu_cull_) {
+        // make the counts available to read_cull_stats
+        VkMemoryBarrier mem_barrier = {};
+        mem_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        mem_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        mem_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vk::CmdPipelineBarrier(data.primary_cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+                               &mem_barrier, 0, nullptr, 0, nullptr);
+    }
+
+    if (timestamps_) vk::CmdWriteTimestamp(data.primary_cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, data.query_pool, 1);
+
     vk::EndCommandBuffer(data.primary_cmd);
 
     // wait for the image to be owned and signal for render completion
@@ -775,7 +1904,19 @@ void Smoke::on_frame(float frame_pred) {
     primary_cmd_submit_info_.pCommandBuffers = &data.primary_cmd;
     primary_cmd_submit_info_.pSignalSemaphores = &back.render_semaphore;
 
-    res = vk::QueueSubmit(queue_, 1, &primary_cmd_submit_info_, data.fence);
+    const auto submit_start = std::chrono::steady_clock::now();
+    const std::chrono::duration<double, std::milli> record_time = submit_start - record_start;
+    frame_stats_.record(FrameStats::PHASE_RECORD, record_time.count());
+
+    {
+        TraceScope submit_trace("vkQueueSubmit");
+        res = vk::QueueSubmit(queue_, 1, &primary_cmd_submit_info_, data.fence);
+    }
+
+    const std::chrono::duration<double, std::milli> submit_time = std::chrono::steady_clock::now() - submit_start;
+    frame_stats_.record(FrameStats::PHASE_SUBMIT, submit_time.count());
+    data.cull_submitted = gpu_cull_;
+    data.timestamps_submitted = timestamps_;
 
     // If QueueSubmit fails due to a resize event, we wait for the GPU and ignore the error
     if (res == VK_ERROR_OUT_OF_DATE_KHR) {
@@ -786,89 +1927,148 @@ void Smoke::on_frame(float frame_pred) {
     }
 
     frame_data_index_ = int((frame_data_index_ + 1) % frame_data_.size()); // (void)res;
+
+    const std::chrono::duration<double, std::milli> frame_time = std::chrono::steady_clock::now() - frame_start;
+    cpu_frame_total_ += frame_time.count() - wait_time.count();
 }
 
-Smoke::Worker::Worker(Smoke &smoke, int index, int object_begin, int object_end)
-        : smoke_(smoke),
-          index_(index),
-          object_begin_(object_begin),
-          object_end_(object_end),
-          tick_interval_(1.0f / (float) smoke.settings_.ticks_per_second),
-          state_(INIT) {}
+void Smoke::dispatch_workers(WorkerJob job, VkFramebuffer fb) {
+    // the previous job must be done before its state is replaced
+    wait_workers();
 
-void Smoke::Worker::start() {
-    state_ = IDLE;
-    thread_ = std::thread(Smoke::Worker::thread_loop, this);
-}
+    worker_fb_ = fb;
+    if (job == JOB_STEP || job == JOB_STEP_DRAW) sim_stepped_ = true;
 
-void Smoke::Worker::stop() {
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        state_ = INIT;
+    const int item_count = static_cast<int>(chunks_.size()) * (job == JOB_STEP_DRAW ? 2 : 1);
+    const int worker_count = static_cast<int>(workers_.size());
+    for (int i = 0; i < worker_count; i++)
+        workers_[i]->assign(item_count * i / worker_count, item_count * (i + 1) / worker_count);
+
+    // run on this thread before the workers start or after they stop; the
+    // first worker steals whatever the others were dealt
+    if (!workers_running_) {
+        workers_[0]->run_job(job);
+        return;
     }
-    state_cv_.notify_one();
 
-    thread_.join();
+    worker_job_ = job;
+    workers_pending_.store(worker_count, std::memory_order_relaxed);
+    worker_epoch_.fetch_add(1, std::memory_order_release);
+    worker_epoch_.notify_all();
 }
 
-void Smoke::Worker::update_simulation() {
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        bool started = (state_ != INIT);
+void Smoke::wait_workers() {
+    int pending = workers_pending_.load(std::memory_order_acquire);
+    TraceScope trace(pending ? "wait workers" : nullptr);
+    for (int spin = 0; pending && spin < spin_count; spin++) {
+        cpu_relax();
+        pending = workers_pending_.load(std::memory_order_acquire);
+    }
 
-        state_ = STEP;
+    while (pending) {
+        workers_pending_.wait(pending, std::memory_order_acquire);
+        pending = workers_pending_.load(std::memory_order_acquire);
+    }
 
-        // step directly
-        if (!started) {
-            smoke_.update_simulation(*this);
-            state_ = INIT;
-        }
+    if (sim_stepped_) {
+        sim_.swap_buffers();
+        sim_stepped_ = false;
     }
-    state_cv_.notify_one();
 }
 
-void Smoke::Worker::draw_objects(VkFramebuffer fb) {
-    // wait for step_objects first
-    wait_idle();
+void Smoke::flush_step() {
+    if (!step_pending_) return;
 
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        bool started = (state_ != INIT);
+    dispatch_workers(JOB_STEP);
+    wait_workers();
+    step_pending_ = false;
+}
 
-        fb_ = fb;
-        state_ = DRAW;
+void Smoke::stop_workers() {
+    wait_workers();
 
-        // render directly
-        if (!started) {
-            smoke_.draw_objects(*this);
-            state_ = INIT;
-        }
-    }
-    state_cv_.notify_one();
+    worker_job_ = JOB_STOP;
+    worker_epoch_.fetch_add(1, std::memory_order_release);
+    worker_epoch_.notify_all();
+
+    for (auto &work: workers_) work->join();
+    workers_running_ = false;
 }
 
-void Smoke::Worker::wait_idle() {
-    std::unique_lock<std::mutex> lock(mutex_);
-    bool started = (state_ != INIT);
+Smoke::Worker::Worker(Smoke &smoke, int index) : smoke_(smoke), index_(index) {}
+
+void Smoke::Worker::start() {
+    thread_ = std::thread(Smoke::Worker::thread_loop, this);
+}
 
-    if (started) state_cv_.wait(lock, [this] { return (state_ == IDLE); });
+void Smoke::Worker::join() {
+    thread_.join();
 }
 
 void Smoke::Worker::update_loop() {
+    Trace::set_thread_name("worker " + std::to_string(index_));
+
+    uint64_t epoch = smoke_.worker_epoch_.load(std::memory_order_acquire);
+
     while (true) {
-        std::unique_lock<std::mutex> lock(mutex_);
+        epoch = wait_for_change(smoke_.worker_epoch_, epoch);
 
-        state_cv_.wait(lock, [this] { return (state_ != IDLE); });
-        if (state_ == INIT) break;
+        const WorkerJob job = smoke_.worker_job_;
+        if (job == JOB_STOP) break;
 
-        assert(state_ == STEP || state_ == DRAW);
-        if (state_ == STEP)
-            smoke_.update_simulation(*this);
-        else
-            smoke_.draw_objects(*this);
+        run_job(job);
 
-        state_ = IDLE;
-        lock.unlock();
-        state_cv_.notify_one();
+        if (smoke_.workers_pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            smoke_.workers_pending_.notify_one();
     }
 }
+
+void Smoke::Worker::run_job(WorkerJob job) {
+    const auto start = std::chrono::steady_clock::now();
+
+    int item;
+    while ((item = pop()) >= 0 || (item = steal()) >= 0) smoke_.run_item(*this, job, item);
+
+    const std::chrono::duration<double, std::milli> busy_time = std::chrono::steady_clock::now() - start;
+    busy_time_ += busy_time.count();
+}
+
+void Smoke::Worker::assign(int begin, int end) {
+    queue_.store((static_cast<uint64_t>(end) << 32) | static_cast<uint32_t>(begin), std::memory_order_relaxed);
+}
+
+int Smoke::Worker::pop() {
+    uint64_t queue = queue_.load(std::memory_order_relaxed);
+    while (true) {
+        const auto head = static_cast<uint32_t>(queue);
+        const auto tail = static_cast<uint32_t>(queue >> 32);
+        if (head >= tail) return -1;
+
+        if (queue_.compare_exchange_weak(queue, queue + 1, std::memory_order_relaxed)) return static_cast<int>(head);
+    }
+}
+
+int Smoke::Worker::take_back() {
+    uint64_t queue = queue_.load(std::memory_order_relaxed);
+    while (true) {
+        const auto head = static_cast<uint32_t>(queue);
+        const auto tail = static_cast<uint32_t>(queue >> 32);
+        if (head >= tail) return -1;
+
+        if (queue_.compare_exchange_weak(queue, queue - (uint64_t(1) << 32), std::memory_order_relaxed))
+            return static_cast<int>(tail - 1);
+    }
+}
+
+int Smoke::Worker::steal() {
+    const auto worker_count = static_cast<int>(smoke_.workers_.size());
+    for (int i = 1; i < worker_count; i++) {
+        const int item = smoke_.workers_[(index_ + i) % worker_count]->take_back();
+        if (item >= 0) {
+            steal_count_++;
+            return item;
+        }
+    }
+
+    return -1;
+}
@@ -17,9 +17,9 @@
 #ifndef SMOKE_H
 #define SMOKE_H
 
-#include <condition_variable>
+#include <array>
+#include <atomic>
 #include <memory>
-#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
@@ -27,11 +27,11 @@
 #include <vulkan/vulkan.h>
 #include <glm/glm.hpp>
 
+#include "Allocator.h"
+#include "Meshes.h"
 #include "Simulation.h"
 #include "Game.h"
 
-class Meshes;
-
 class Smoke : public Game {
    public:
     explicit Smoke(const std::vector<std::string> &args);
@@ -48,48 +48,105 @@ class Smoke : public Game {
 
     void on_frame(float frame_pred) override;
 
+    std::string take_frame_stats() override;
+
    private:
+    enum DrawMode {
+        // one draw per object, whose firstInstance indexes the packed object data
+        DRAW_FIRST_INSTANCE,
+        // one descriptor set bind with a dynamic offset and one draw per object
+        DRAW_DYNAMIC_OFFSET,
+        // one push constant update and one draw per object
+        DRAW_PUSH_CONSTANTS,
+        // objects bucketed by mesh, one instanced draw per mesh per chunk
+        DRAW_INSTANCED,
+        // one indirect draw command per object, submitted per chunk
+        DRAW_INDIRECT,
+    };
+
+    // how the model matrix of each object is streamed in the buffer draw modes
+    enum TransformEncoding {
+        // column-major mat4, 64 bytes
+        TRANSFORM_MAT4,
+        // the top three rows of the matrix, 48 bytes
+        TRANSFORM_AFFINE,
+        // position, uniform scale and unit quaternion, 32 bytes
+        TRANSFORM_QUAT,
+        // the same in half precision, 16 bytes; positions are quantized to
+        // about 1e-3, a large step next to the 0.005 scale of a pyramid
+        TRANSFORM_QUAT_HALF,
+    };
+
+    enum WorkerJob {
+        JOB_STOP,
+        JOB_STEP,
+        JOB_DRAW,
+        // steps the next tick while the last one is drawn, chunk by chunk
+        JOB_STEP_DRAW,
+    };
+
+    // a fixed-size range of objects, stepped and recorded as one unit
+    struct Chunk {
+        int index;
+        int object_begin;
+        int object_end;
+
+        // for DRAW_INSTANCED, objects of each mesh type in the range
+        std::array<int, Meshes::MESH_COUNT> mesh_counts;
+    };
+
     class Worker {
        public:
-        Worker(Smoke &smoke, int index, int object_begin, int object_end);
+        Worker(Smoke &smoke, int index);
 
         void start();
-        void stop();
-        void update_simulation();
-        void draw_objects(VkFramebuffer fb);
-        void wait_idle();
+        void join();
+
+        // runs the items queued to this worker, then steals from the others
+        void run_job(WorkerJob job);
+
+        // replaces the queue with items [begin, end)
+        void assign(int begin, int end);
 
         Smoke &smoke_;
 
         const int index_;
-        const int object_begin_;
-        const int object_end_;
 
-        const float tick_interval_;
+        // for CPU culling, the visible objects summed over the frames since
+        // the last stats report
+        uint64_t visible_total_{};
 
-        VkFramebuffer fb_{};
+        // items taken from other workers and time spent running items since
+        // the last stats report
+        uint64_t steal_count_{};
+        double busy_time_{};
 
-       private:
-        enum State {
-            INIT,
-            IDLE,
-            STEP,
-            DRAW,
-        };
+        // transform bytes written to the frame data since the last stats report
+        uint64_t streamed_bytes_{};
 
+       private:
         void update_loop();
 
         static void thread_loop(Worker *worker) { worker->update_loop(); }
 
+        // return the item index, or -1 when the queue is empty
+        int pop();
+        int take_back();
+        int steal();
+
+        // the owner pops from the front and thieves take from the back; both
+        // ends are packed into one word, head in the low half and tail in the
+        // high half, so that either side claims an item with a single CAS
+        std::atomic<uint64_t> queue_{0};
+
         std::thread thread_{};
-        std::mutex mutex_{};
-        std::condition_variable state_cv_{};
-        State state_{};
     };
 
     struct Camera {
         glm::vec3 eye_pos{};
         glm::mat4 view_projection{};
+        // normalized, facing into the view volume
+        std::array<glm::vec4, 6> frustum_planes{};
 
         explicit Camera(float eye) : eye_pos(eye) {}
     };
@@ -99,27 +156,87 @@ class Smoke : public Game {
         VkFence fence{};
 
         VkCommandBuffer primary_cmd{};
-        std::vector<VkCommandBuffer> worker_cmds{};
 
+        // secondary command buffers are allocated from a pool per worker as
+        // the worker records chunks, and the pool is reset with the fence
+        struct WorkerCommands {
+            VkCommandPool pool{};
+            std::vector<VkCommandBuffer> cmds{};
+            size_t used{};
+        };
+        std::vector<WorkerCommands> worker_cmds{};
+        // the buffer that recorded each chunk, executed in chunk order
+        std::vector<VkCommandBuffer> chunk_cmds{};
+
+        // the transforms streamed this frame, the camera and, depending on the
+        // draw mode, draw commands and cull results
         VkBuffer buf{};
+        Allocator::Allocation mem{};
         uint8_t *base{};
+        VkDescriptorSet camera_desc_set{};
         VkDescriptorSet desc_set{};
+
+        VkDescriptorSet cull_desc_set{};
+        // the cull counts hold the results of a submitted frame
+        bool cull_submitted{};
+
+        // GPU timestamps at the start and end of the frame followed by a pair
+        // per chunk, and the worker that recorded each chunk
+        VkQueryPool query_pool{};
+        std::vector<int> chunk_workers{};
+        // the timestamps hold the results of a submitted frame
+        bool timestamps_submitted{};
     };
 
     // called by the constructor
     void init_workers();
 
     bool multithread_;
-    bool use_push_constants_;
+    DrawMode draw_mode_;
+    bool multi_draw_indirect_{};
+    bool draw_indirect_count_{};
+    bool gpu_cull_{};
+    bool cpu_cull_{};
+    bool pipelined_{};
+    TransformEncoding transform_encoding_{TRANSFORM_MAT4};
 
     // called mostly by on_key
     void update_camera();
 
+    // called by on_tick
+    void log_state_hash();
+
     bool sim_paused_;
     Simulation sim_;
+    int tick_count_{0};
+    // fraction of a tick since the last one, for the draws of this frame
+    float frame_pred_{};
     Camera camera_;
 
     std::vector<std::unique_ptr<Worker>> workers_{};
+    std::vector<Chunk> chunks_{};
+
+    // Lock-free handoff to the workers.  The main thread publishes a job by
+    // bumping the epoch and every worker decrements the pending count when it
+    // is done, so dispatching and waiting touch one atomic each.
+    // The items of a job, one per chunk or two for JOB_STEP_DRAW, are dealt
+    // out contiguously before each job.
+    void dispatch_workers(WorkerJob job, VkFramebuffer fb = VK_NULL_HANDLE);
+    void wait_workers();
+    void stop_workers();
+
+    bool workers_running_{};
+    WorkerJob worker_job_{};
+    std::atomic<uint64_t> worker_epoch_{0};
+    std::atomic<int> workers_pending_{0};
+    VkFramebuffer worker_fb_{};
+
+    // a tick was stepped into the simulation's back buffers and is published
+    // once the workers are done
+    bool sim_stepped_{};
+    // when pipelined, a tick waiting to be stepped by the next frame
+    bool step_pending_{};
+    void flush_step();
 
     // called by attach_shell
     void create_render_pass();
@@ -127,6 +244,12 @@ class Smoke : public Game {
     void create_descriptor_set_layout();
     void create_pipeline_layout();
     void create_pipeline();
+    void create_cull_pipeline();
+
+    // loaded from and saved to a file per device, vendor and driver version
+    void create_pipeline_cache();
+    void destroy_pipeline_cache();
+    [[nodiscard]] std::string pipeline_cache_path() const;
 
     void create_frame_data();
     void destroy_frame_data();
@@ -134,7 +257,13 @@ class Smoke : public Game {
     void create_command_buffers();
     void create_buffers();
     void create_buffer_memory();
+    void create_static_buffer();
     void create_descriptor_sets();
+    void create_query_pools();
+    [[nodiscard]] VkDescriptorType frame_data_descriptor_type() const {
+        return (draw_mode_ == DRAW_DYNAMIC_OFFSET) ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC
+                                                   : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    }
 
     VkPhysicalDevice physical_dev_{};
     VkDevice dev_{};
@@ -143,25 +272,49 @@ class Smoke : public Game {
     VkFormat format_{};
 
     VkPhysicalDeviceProperties physical_dev_props_{};
-    std::vector<VkMemoryPropertyFlags> mem_flags_{};
+    // all buffer memory is sub-allocated from here
+    std::unique_ptr<Allocator> allocator_{};
 
     const Meshes *meshes_{};
 
     VkRenderPass render_pass_{};
     VkShaderModule vs_{};
     VkShaderModule fs_{};
+    // set 0 holds the camera and set 1 the objects
+    VkDescriptorSetLayout camera_desc_set_layout_{};
     VkDescriptorSetLayout desc_set_layout_{};
     VkPipelineLayout pipeline_layout_{};
     VkPipeline pipeline_{};
+    VkPipelineCache pipeline_cache_{};
+
+    VkShaderModule cull_cs_{};
+    VkDescriptorSetLayout cull_desc_set_layout_{};
+    VkPipelineLayout cull_pipeline_layout_{};
+    VkPipeline cull_pipeline_{};
 
     VkCommandPool primary_cmd_pool_{};
-    std::vector<VkCommandPool> worker_cmd_pools_{};
     VkDescriptorPool desc_pool_{};
-    VkDeviceMemory frame_data_mem_{};
-    VkDeviceSize frame_data_aligned_size_{};
+    VkDeviceSize frame_data_object_size_{};
+    // for DRAW_INSTANCED, where the object of each instance is in FrameData::buf
+    VkDeviceSize instance_objects_offset_{};
+    // where the camera uniform block is in FrameData::buf
+    VkDeviceSize camera_offset_{};
+    // for DRAW_INDIRECT, where the draw commands start in FrameData::buf
+    VkDeviceSize indirect_offset_{};
+    // for GPU culling, where the bounding radii, the visible and culled
+    // counts, and the compacted draw commands start in FrameData::buf
+    VkDeviceSize bounds_offset_{};
+    VkDeviceSize cull_counts_offset_{};
+    VkDeviceSize visible_draws_offset_{};
     std::vector<FrameData> frame_data_{};
     int frame_data_index_{0};
 
+    // the light of each object, constant for its lifetime and written once
+    VkBuffer static_buf_{};
+    Allocator::Allocation static_mem_{};
+    VkDeviceSize static_object_size_{};
+    bool static_staged_{};
+
     VkClearValue render_pass_clear_value_{};
     VkRenderPassBeginInfo render_pass_begin_info_{};
 
@@ -169,9 +322,42 @@ class Smoke : public Game {
     VkPipelineStageFlags primary_cmd_submit_wait_stages_{};
     VkSubmitInfo primary_cmd_submit_info_{};
 
+    // called by on_frame
+    void cmd_cull(const FrameData &data) const;
+    // draws what cmd_cull left visible, inside the render pass
+    void cmd_draw_culled(const FrameData &data) const;
+    void read_cull_stats(const FrameData &data);
+
+    // CPU time blocked on frame fences since the last stats report
+    double fence_wait_total_{};
+    double fence_wait_max_{};
+    int fence_wait_count_{};
+
+    uint64_t cull_visible_count_{};
+    uint64_t cull_culled_count_{};
+    int cull_frame_count_{};
+
+    // when the queue supports timestamps, GPU time is read back from the
+    // frame data once its fence signals, frames_in_flight frames later
+    void read_timestamps(const FrameData &data);
+
+    bool timestamps_{};
+    uint64_t timestamp_mask_{};
+    // nanoseconds per timestamp tick
+    double timestamp_period_{};
+
+    // CPU time recording and submitting frames, excluding fence waits, and
+    // GPU time executing them, in total and per worker, since the last stats
+    // report
+    double cpu_frame_total_{};
+    double gpu_frame_total_{};
+    double gpu_frame_max_{};
+    int gpu_frame_count_{};
+    std::vector<double> worker_gpu_time_{};
+
     // called by attach_swapchain
     void prepare_viewport(const VkExtent2D &extent);
-    void prepare_framebuffers(VkSwapchainKHR swapchain);
+    void prepare_framebuffers(const std::vector<VkImage> &images);
 
     VkExtent2D extent_{};
     VkViewport viewport_{};
@@ -182,9 +368,18 @@ class Smoke : public Game {
     std::vector<VkFramebuffer> framebuffers_{};
 
     // called by workers
-    void update_simulation(const Worker &work);
-    void draw_object(const Simulation::Object &obj, FrameData &data, VkCommandBuffer cmd) const;
-    void draw_objects(Worker &work);
+    void run_item(Worker &work, WorkerJob job, int item);
+    void update_simulation(const Chunk &chunk);
+    void draw_object(int index, FrameData &data, VkCommandBuffer cmd) const;
+    void draw_objects(Worker &work, const Chunk &chunk);
+    void draw_instanced(const Chunk &chunk, FrameData &data, VkCommandBuffer cmd) const;
+    void draw_indirect(const Chunk &chunk, FrameData &data, VkCommandBuffer cmd) const;
+    // writes the transform of an object in transform_encoding_
+    void write_transform(int index, uint8_t *dst) const;
+    [[nodiscard]] bool is_visible(int index) const { return !cpu_cull_ || cull_visible_[index]; }
+
+    // for CPU culling, one flag per object
+    std::vector<uint8_t> cull_visible_{};
 
     Worker *worker{};
 };
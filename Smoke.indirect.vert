@@ -0,0 +1,46 @@
+#version 310 es
+#extension GL_GOOGLE_include_directive : require
+
+layout(location = 0) in vec3 in_pos;
+layout(location = 1) in vec3 in_normal;
+
+struct object_block {
+	vec3 light_pos;
+	vec3 light_color;
+};
+
+layout(std140, set = 0, binding = 0) uniform camera_block {
+	mat4 view_projection;
+} camera;
+
+// streamed every frame in one of the encodings of Smoke.transform.glsl
+layout(std430, set = 1, binding = 0) readonly buffer transforms {
+	uvec4 transform_data[];
+};
+
+#include "Smoke.transform.glsl"
+
+// written once
+layout(std430, set = 1, binding = 1) readonly buffer objects {
+	object_block params[];
+};
+
+layout(location = 0) out vec3 color;
+
+void main()
+{
+	// firstInstance of each draw is the object index
+	mat4 model = decode_transform(gl_InstanceIndex * transform_words());
+	object_block p = params[gl_InstanceIndex];
+
+	vec3 world_light = vec3(model * vec4(p.light_pos, 1.0));
+	vec3 world_pos = vec3(model * vec4(in_pos, 1.0));
+	vec3 world_normal = mat3(model) * in_normal;
+
+	vec3 light_dir = world_light - world_pos;
+	float brightness = dot(light_dir, world_normal) / length(light_dir) / length(world_normal);
+	brightness = abs(brightness);
+
+	gl_Position = camera.view_projection * vec4(world_pos, 1.0);
+	color = p.light_color * brightness;
+}
@@ -0,0 +1,55 @@
+// Decodes the transforms streamed every frame.  Included after the shader
+// declares its transform buffer as uvec4 transform_data[].
+
+// 0: mat4, 1: the top three rows of the matrix, 2: position and scale
+// followed by a unit quaternion, 3: the same in half precision
+layout(constant_id = 0) const int transform_encoding = 0;
+
+// 16-byte words per transform
+int transform_words()
+{
+	return transform_encoding == 0 ? 4 : transform_encoding == 1 ? 3 : transform_encoding == 2 ? 2 : 1;
+}
+
+mat4 decode_transform(int first)
+{
+	if (transform_encoding == 1) {
+		vec4 r0 = uintBitsToFloat(transform_data[first]);
+		vec4 r1 = uintBitsToFloat(transform_data[first + 1]);
+		vec4 r2 = uintBitsToFloat(transform_data[first + 2]);
+		return transpose(mat4(r0, r1, r2, vec4(0.0, 0.0, 0.0, 1.0)));
+	}
+
+	if (transform_encoding >= 2) {
+		vec4 pos_scale;
+		vec4 q;
+		if (transform_encoding == 2) {
+			pos_scale = uintBitsToFloat(transform_data[first]);
+			q = uintBitsToFloat(transform_data[first + 1]);
+		} else {
+			uvec4 h = transform_data[first];
+			pos_scale = vec4(unpackHalf2x16(h.x), unpackHalf2x16(h.y));
+			q = normalize(vec4(unpackHalf2x16(h.z), unpackHalf2x16(h.w)));
+		}
+
+		vec3 q2 = q.xyz * 2.0;
+		float xx = q.x * q2.x;
+		float yy = q.y * q2.y;
+		float zz = q.z * q2.z;
+		float xy = q.x * q2.y;
+		float xz = q.x * q2.z;
+		float yz = q.y * q2.z;
+		float wx = q.w * q2.x;
+		float wy = q.w * q2.y;
+		float wz = q.w * q2.z;
+		float s = pos_scale.w;
+
+		return mat4(s * (1.0 - yy - zz), s * (xy + wz), s * (xz - wy), 0.0,
+		            s * (xy - wz), s * (1.0 - xx - zz), s * (yz + wx), 0.0,
+		            s * (xz + wy), s * (yz - wx), s * (1.0 - xx - yy), 0.0,
+		            pos_scale.xyz, 1.0);
+	}
+
+	return mat4(uintBitsToFloat(transform_data[first]), uintBitsToFloat(transform_data[first + 1]),
+	            uintBitsToFloat(transform_data[first + 2]), uintBitsToFloat(transform_data[first + 3]));
+}
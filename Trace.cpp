@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2016 Google, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Trace.h"
+
+namespace {
+
+struct TraceEvent {
+    const char *name;
+    int chunk;
+    uint64_t begin_ns;
+    uint64_t end_ns;
+};
+
+struct ThreadBuffer {
+    std::string name{};
+    int tid{};
+
+    std::vector<TraceEvent> events{};
+    // events ever recorded; the ring holds the last events.size() of them
+    std::atomic<uint64_t> count{0};
+};
+
+// taken when a thread records for the first time and when writing, never
+// per event
+std::mutex buffers_mutex;
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+size_t buffer_capacity;
+
+std::chrono::steady_clock::time_point epoch;
+
+thread_local ThreadBuffer *thread_buffer = nullptr;
+
+ThreadBuffer &get_thread_buffer() {
+    if (thread_buffer) return *thread_buffer;
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+
+    auto buf = std::make_unique<ThreadBuffer>();
+    buf->tid = static_cast<int>(buffers.size());
+    buf->name = "thread " + std::to_string(buf->tid);
+    buf->events.resize(buffer_capacity);
+
+    thread_buffer = buf.get();
+    buffers.push_back(std::move(buf));
+
+    return *thread_buffer;
+}
+
+// names are string literals, but escape them anyway
+void write_string(std::ostream &out, const std::string &str) {
+    out << '"';
+    for (char c: str) {
+        if (c == '"' || c == '\\') out << '\\';
+        out << c;
+    }
+    out << '"';
+}
+
+}  // namespace
+
+bool Trace::enabled_ = false;
+
+void Trace::enable(size_t events_per_thread) {
+    buffer_capacity = events_per_thread;
+    epoch = std::chrono::steady_clock::now();
+    enabled_ = true;
+}
+
+void Trace::set_thread_name(const std::string &name) {
+    if (!enabled_) return;
+
+    ThreadBuffer &buf = get_thread_buffer();
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    buf.name = name;
+}
+
+uint64_t Trace::now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Trace::record(const char *name, int chunk, uint64_t begin_ns, uint64_t end_ns) {
+    ThreadBuffer &buf = get_thread_buffer();
+
+    // only this thread writes the ring; publish the event after writing it
+    const uint64_t count = buf.count.load(std::memory_order_relaxed);
+    buf.events[count % buf.events.size()] = {name, chunk, begin_ns, end_ns};
+    buf.count.store(count + 1, std::memory_order_release);
+}
+
+bool Trace::write(const std::string &path) {
+    std::ofstream out(path);
+    if (!out) return false;
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+
+    // timestamps and durations are in microseconds
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    const char *sep = "\n";
+    for (const auto &buf: buffers) {
+        out << sep << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buf->tid
+            << ", \"args\": {\"name\": ";
+        write_string(out, buf->name);
+        out << "}}";
+        sep = ",\n";
+
+        const uint64_t count = buf->count.load(std::memory_order_acquire);
+        const uint64_t capacity = buf->events.size();
+        for (uint64_t i = (count > capacity) ? count - capacity : 0; i < count; i++) {
+            const TraceEvent &ev = buf->events[i % capacity];
+
+            out << sep << "{\"name\": ";
+            write_string(out, ev.name);
+            out << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buf->tid << ", \"ts\": " << ev.begin_ns / 1000 << "."
+                << (ev.begin_ns % 1000) / 100 << ", \"dur\": " << (ev.end_ns - ev.begin_ns) / 1000 << "."
+                << ((ev.end_ns - ev.begin_ns) % 1000) / 100;
+            if (ev.chunk >= 0) out << ", \"args\": {\"chunk\": " << ev.chunk << "}";
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2016 Google, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <string>
+
+// Timeline markers exported as Chrome trace JSON, viewable in chrome://tracing
+// or Perfetto.  Every thread records complete events into its own ring, which
+// only that thread writes, so recording takes no lock; the oldest events are
+// overwritten once a ring is full.  When tracing is disabled a marker costs a
+// load and a branch.
+class Trace {
+   public:
+    // must be called before any thread records
+    static void enable(size_t events_per_thread = 1 << 16);
+    [[nodiscard]] static bool enabled() { return enabled_; }
+
+    // names the calling thread in the trace
+    static void set_thread_name(const std::string &name);
+
+    [[nodiscard]] static uint64_t now_ns();
+    // name must outlive the trace; chunk is the chunk worked on, or -1
+    static void record(const char *name, int chunk, uint64_t begin_ns, uint64_t end_ns);
+
+    // call while the other threads are not recording
+    [[nodiscard]] static bool write(const std::string &path);
+
+   private:
+    static bool enabled_;
+};
+
+// records an event from construction to destruction, or nothing for a null name
+class TraceScope {
+   public:
+    explicit TraceScope(const char *name, int chunk = -1)
+        : name_(Trace::enabled() ? name : nullptr), chunk_(chunk), begin_ns_(name_ ? Trace::now_ns() : 0) {}
+    ~TraceScope() {
+        if (name_) Trace::record(name_, chunk_, begin_ns_, Trace::now_ns());
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+   private:
+    const char *name_;
+    int chunk_;
+    uint64_t begin_ns_;
+};
+
+#endif  // TRACE_H